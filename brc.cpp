@@ -1,294 +1,2864 @@
-/*
-	BRC - Behemoth Rank Coding for BWT
-	MIT License
-	Copyright (c) 2018 Lucas Marsh
-	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
-	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
-	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-*/
-#include "brc.hpp"
-
-#define BRC_VSRC_FOOTER_SIZE (sizeof(uint32_t) * 256)
-#define BRC_RLT_FOOTER_SIZE (1)
-#define BRC_PAD_SIZE (16)
-
-/*** basic utilities **/
-void brc_memcopy_separate(void * dst, void * src, size_t size) {
-	unsigned char * s = (unsigned char*)src;
-	unsigned char * d = (unsigned char*)dst;
-	if((((size_t)s) % 8) == 0 && (((size_t)d) % 8) == 0) {
-		size_t i = 0;
-		while((i + 8) < size) {
-			*((uint64_t*)&d[i]) = *((uint64_t*)&s[i]);
-			i += 8;
-		}
-		while(i < size) {
-			d[i] = s[i];
-			i++;
-		}
-	} else {
-		memcpy(dst, src, size);
-	}
-}
-
-void * brc_aligned_malloc(size_t bytes, size_t alignment) {
-	char * base_ptr;
-	char * aligned_ptr;
-
-	size_t pad = alignment + sizeof(size_t);
-	if((base_ptr =(char*)malloc(bytes + pad)) == NULL)
-		return NULL;
-	size_t addr = (size_t)(base_ptr + pad);
-	aligned_ptr = (char *)(addr - (addr % alignment));
-	*((size_t*)aligned_ptr - 1) = (size_t)base_ptr;
-
-	return (void*)aligned_ptr;
-}
-
-void brc_aligned_free(void * aligned_ptr) {
-	free( (char*)(*((size_t*)aligned_ptr - 1)) );
-}
-
-/*** bytewise zero run length coder  ***/
-size_t rlt_forwards(unsigned char * src, unsigned char * dst, size_t size) {
-	unsigned char * write_head = dst;
-	unsigned char * write_end = write_head + size;
-	size_t i = 0;
-	while(i < size && write_head < write_end) {	
-		if(src[i] == 0) {
-			size_t run = 1;
-			while ((i + run) < size && src[i] == src[i + run])
-				run++;
-			i += run;
-			size_t L = run + 1; 
-			size_t msb = 0;
-			asm("bsrq %1,%0" : "=r"(msb) : "r"(L));
-			while(msb--)
-				*write_head++ = (L >> msb) & 1;	
-		} else if (src[i] >= 0xfe) {
-			*write_head++ = 0xff;
-			*write_head++ = src[i++] == 0xff;
-		} else {
-			*write_head++ = src[i++] + 1;
-		}
-	}
-	if(i < size) {
-		brc_memcopy_separate(dst, src, size);
-		*(dst + size) = 0;
-		return size + BRC_RLT_FOOTER_SIZE;
-	} else {
-		size_t packed_size = write_head - dst;
-		*(dst + packed_size) = 1;
-		return packed_size + BRC_RLT_FOOTER_SIZE;
-	}
-}
-
-size_t rlt_reverse(unsigned char * src, unsigned char * dst, size_t size) {
-	size_t unpacked = size - BRC_RLT_FOOTER_SIZE;
-	if(*(src + unpacked)  == 0) {
-		brc_memcopy_separate(dst, src, unpacked);
-		return unpacked;
-	} else {	
-		unsigned char * write_head = dst;
-		unsigned char * write_end = write_head + unpacked;
-		size_t i = 0; 
-		while(i < unpacked) {
-			if(src[i] == 0xff) {
-				i++;
-				*write_head++ = 0xfe + src[i++];
-			} else if (src[i] > 1) {
-				*write_head++ = src[i++] - 1;
-			} else {
-				int rle = 1;
-				while (src[i] <= 1 && i < unpacked)
-					rle = (rle << 1) | src[i++];
-				rle -= 1;
-				while(rle--)
-					*write_head++ = 0;	
-			}
-		}
-		return write_head - dst;
-	}
-}
-
-/*** vectorized sorted rank transform ***/
-struct vmtf_s {
-	unsigned char map[256];
-};
-
-inline void init_vmtf(vmtf_s * x) {
-	for(size_t i = 0; i < 256; i++)
-		x->map[i] = i;
-}
-
-inline void inverse_vmtf_update_only(vmtf_s * x, unsigned char r, unsigned char s) {
-	size_t j = 0;
-	do x->map[j] = x->map[j + 1];
-	while(++j < r);
-	x->map[r] = s;
-}
-
-inline unsigned char inverse_vmtf_update_single(vmtf_s * x, unsigned char r, unsigned char s) {
-	inverse_vmtf_update_only(x, r, s);
-	return x->map[0];
-}
-
-inline void generate_sorted_map(uint32_t * freqs, unsigned char * map) {
-	uint32_t freqs_cpy[256];
-	for(size_t i = 0; i < 256; i++)
-		freqs_cpy[i] = freqs[i];
-
-	for(size_t j = 0; j < 256; j++) {
-		size_t max = 0;
-		unsigned char bsym = 0;
-		for(int i = 0; i < 256; i++) {
-			if(freqs_cpy[i] > max) {
-				bsym = i;
-				max = freqs_cpy[i];
-			}
-		}
-		if(max == 0) break;
-		else map[j] = bsym;
-		freqs_cpy[bsym] = 0;
-	}
-}
-
-int vsrc_forwards(unsigned char * src, unsigned char * dst, size_t src_size) {
-	unsigned char * read_head  = src;
-	unsigned char * write_head = dst;
-
-	vmtf_s state;
-	init_vmtf(&state);
-
-	size_t bucket[256] = {0};
-	uint32_t freqs[256] = {0};
-	unsigned char sort_map[256], s, r;
-
-	size_t unique_syms = 0;
-	for (size_t i = 0; i < src_size; i++) {
-		s = read_head[i];
-		if (freqs[s] == 0)
-			state.map[s] = unique_syms++;
-		freqs[s]++;
-	}
-
-	brc_memcopy_separate(dst + src_size, freqs, BRC_VSRC_FOOTER_SIZE); 
-	generate_sorted_map(freqs, sort_map);
-
-	for(size_t i = 0, bucket_pos = 0; i < unique_syms; i++) {
-		s = sort_map[i];
-		bucket[s] = bucket_pos;
-		bucket_pos += freqs[s];
-	}
-
-	for(size_t i = 0; i < src_size; i++) {
-		s = read_head[i]; 
-		r = state.map[s]; 
-		write_head[bucket[s]++] = r;
-		if(r) {
-			for(size_t i = 0; i < 256; i++)
-				state.map[i] += (state.map[i] < r);
-			state.map[s] = 0;
-		}
-	}
-	return src_size + BRC_VSRC_FOOTER_SIZE;
-}
-
-int vsrc_reverse(unsigned char * src, unsigned char * dst, size_t src_size) {
-	unsigned char * read_head  = src;
-	unsigned char * write_head = dst;
-	size_t dst_size = src_size - BRC_VSRC_FOOTER_SIZE;
-
-	vmtf_s state;
-	init_vmtf(&state);
-
-	size_t bucket[256] = {0}, bucket_end[256] = {0};
-	uint32_t freqs[256] = {0};
-	unsigned char sort_map[256], s, r;
-
-	brc_memcopy_separate(freqs, src + dst_size, BRC_VSRC_FOOTER_SIZE); 
-
-	size_t total = 0;
-	for(size_t i = 0; i < 256; i++)
-		total += freqs[i];
-
-	if(total != dst_size) 
-		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
-	
-	size_t unique_syms = 0;
-	for(size_t i = 0; i < 256; i++)
-		if(freqs[i] > 0) 
-			unique_syms++;
-	
-	generate_sorted_map(freqs, sort_map);
-
-	for(size_t i = 0, bucket_pos = 0; i < unique_syms; i++) {
-		s = sort_map[i];
-		state.map[read_head[bucket_pos]] = s;
-		bucket[s] = bucket_pos + 1;
-		bucket_pos += freqs[s];
-		bucket_end[s] = bucket_pos;
-	}
-
-	s = state.map[0];
-	for(size_t i = 0; i < dst_size; i++) {
-		write_head[i] = s, r = 0xff;
-		if(bucket[s] < bucket_end[s]) r = read_head[bucket[s]++];
-		if(r) s = inverse_vmtf_update_single(&state, r, s); 
-	}
-
-	return dst_size;
-}
-
-/*** BRC TRANSFORM ***/
-size_t brc_safe_memory_bound(size_t x) {
-	return x + BRC_VSRC_FOOTER_SIZE + BRC_RLT_FOOTER_SIZE + BRC_PAD_SIZE;
-}
-
-int brc_init_cxt(brc_cxt_s * brc_cxt, size_t src_size) {
-	size_t mempool = brc_safe_memory_bound(src_size);
-	brc_cxt->block = (unsigned char*)brc_aligned_malloc(mempool, 8);
-	if(brc_cxt->block == NULL) return BRC_EXIT_FAILURE;
-	brc_cxt->eob = mempool;
-	return BRC_EXIT_SUCCESS;
-}
-
-void brc_free_cxt(brc_cxt_s * brc_cxt) {
-	brc_aligned_free(brc_cxt->block);
-	brc_cxt->block = NULL;
-	brc_cxt->size = 0;
-	brc_cxt->eob = 0;
-}
-
-int brc_encode(brc_cxt_s * brc_cxt, unsigned char * src, size_t src_size) {
-	int dst_size = vsrc_forwards(src, brc_cxt->block, src_size);
-	if(dst_size == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
-
-	unsigned char * swap = (unsigned char*)brc_aligned_malloc(brc_safe_memory_bound(dst_size), 8);
-	if(swap == NULL) return BRC_EXIT_FAILURE;
-	brc_memcopy_separate(swap, brc_cxt->block, dst_size);
-
-	size_t packed_size = rlt_forwards(swap, brc_cxt->block, dst_size);
-
-	brc_cxt->size = (size_t)packed_size;
-	brc_aligned_free(swap);
-
-	return BRC_EXIT_SUCCESS;
-}
-
-int brc_decode(brc_cxt_s * brc_cxt, unsigned char * dst, size_t * dst_size) {
-	unsigned char * swap = (unsigned char*)brc_aligned_malloc(brc_safe_memory_bound(brc_cxt->size), 8);
-	if(swap == NULL) return BRC_EXIT_FAILURE;
-	brc_memcopy_separate(swap, brc_cxt->block, brc_cxt->size);
-
-	size_t origin_size = rlt_reverse(swap, brc_cxt->block, brc_cxt->size);
-
-	brc_cxt->size = (size_t)origin_size;
-	brc_aligned_free(swap);
-
-	origin_size = vsrc_reverse(brc_cxt->block, dst, brc_cxt->size);
-	if(origin_size == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
-	*dst_size = (size_t)origin_size;
-
-	return BRC_EXIT_SUCCESS;
-}
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "brc.hpp"
+#include "rans.hpp"
+#include "bwt.hpp"
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BRC_X86 1
+#include <immintrin.h>
+#endif
+
+#define BRC_VSRC_FOOTER_SIZE (sizeof(uint32_t) * 256)
+#define BRC_RLT_FOOTER_SIZE (1)
+#define BRC_PAD_SIZE (16)
+#define BRC_MIN_SEGMENT_SIZE (1 << 16)
+#define BRC_MAX_SEGMENTS (256)
+#define BRC_BITMAP_SIZE (32)
+#define BRC_STAGE_FOOTER_SIZE (1)
+#define BRC_SAMPLE_SIZE (1 << 16) /* bytes of a block the rank stages are tried on */
+#define BRC_INPLACE_SAMPLE_SIZE (1 << 14) /* same for brc_encode_inplace, which tries them on the stack */
+#define BRC_INPLACE_PAD_SIZE (64) /* room past the block for brc_encode_inplace's descriptor and the in place decoder's head start */
+
+/* the last byte of a packed block describes how it was coded */
+#define BRC_BLOCK_RLT (1 << 0) /* zero runs are packed, else the ranks are stored as they are */
+#define BRC_BLOCK_COMPACT (1 << 1) /* frequency header is a bitmap of present symbols followed by variable length counts */
+#define BRC_BLOCK_SHARED (1 << 2) /* buckets follow the shared table instead of the block's own frequencies */
+#define BRC_BLOCK_ENTROPY (1 << 3) /* the run length coded ranks went through order-0 rANS */
+#define BRC_BLOCK_BWT (1 << 4) /* the block was BWT transformed first, its rows precede the descriptor */
+#define BRC_BLOCK_RUN (1 << 5) /* the block is one symbol repeated: its length as a varint, then the symbol */
+#define BRC_BLOCK_STORED (1 << 6) /* the block is stored as it is */
+#define BRC_BLOCK_STAGE (1 << 7) /* the byte before the descriptor names the rank stage, else it was the sorted rank transform */
+
+/* adds the wall clock time since 'mark' to a stage when the context collects timings, and its cycles when it collects stats */
+#define BRC_LAP(cxt, stage, mark) { \
+	if((cxt)->timings) { double now = omp_get_wtime(); (cxt)->timings->stage += now - (mark); (mark) = now; } \
+	BRC_STATS_LAP(cxt, stage) \
+}
+
+#ifdef BRC_STATS
+#define BRC_STATS_START(cxt) if((cxt)->stats) (cxt)->stats->mark = brc_cycles();
+#define BRC_STATS_LAP(cxt, stage) if((cxt)->stats) { uint64_t now = brc_cycles(); (cxt)->stats->cycles.stage += now - (cxt)->stats->mark; (cxt)->stats->mark = now; }
+#else
+#define BRC_STATS_START(cxt)
+#define BRC_STATS_LAP(cxt, stage)
+#endif
+
+/* rows of the BWT: one uint32 per segment and a byte holding the count less one */
+#define BRC_BWT_FOOTER_SIZE (sizeof(uint32_t) * BRC_MAX_SEGMENTS + 1)
+
+/*** basic utilities **/
+void brc_memcopy_separate(void * dst, void * src, size_t size) {
+	unsigned char * s = (unsigned char*)src;
+	unsigned char * d = (unsigned char*)dst;
+	if((((size_t)s) % 8) == 0 && (((size_t)d) % 8) == 0) {
+		size_t i = 0;
+		while((i + 8) < size) {
+			*((uint64_t*)&d[i]) = *((uint64_t*)&s[i]);
+			i += 8;
+		}
+		while(i < size) {
+			d[i] = s[i];
+			i++;
+		}
+	} else {
+		memcpy(dst, src, size);
+	}
+}
+
+void * brc_aligned_malloc(size_t bytes, size_t alignment) {
+	char * base_ptr;
+	char * aligned_ptr;
+
+	size_t pad = alignment + sizeof(size_t);
+	if((base_ptr =(char*)malloc(bytes + pad)) == NULL)
+		return NULL;
+	size_t addr = (size_t)(base_ptr + pad);
+	aligned_ptr = (char *)(addr - (addr % alignment));
+	*((size_t*)aligned_ptr - 1) = (size_t)base_ptr;
+
+	return (void*)aligned_ptr;
+}
+
+void brc_aligned_free(void * aligned_ptr) {
+	free( (char*)(*((size_t*)aligned_ptr - 1)) );
+}
+
+/*** block allocators ***/
+/*
+	The buckets of a megabyte block are written all over it, so with 4KB pages nearly every rank is a TLB
+	miss; on a huge page the whole block sits behind one or two entries. The page allocators map whole
+	pages, 2MB aligned once a buffer spans a huge page, ask for explicit huge pages or transparent ones,
+	and touch every page before returning so the kernel places it on the calling thread's node. A pool
+	keeps freed buffers by size and node, while a buffer of that size is still in use, and hands them only
+	to threads on that node.
+*/
+#define BRC_CACHE_LINE (64)
+#define BRC_PAGE_SIZE (4096)
+#define BRC_HUGE_PAGE_SIZE ((size_t)2 << 20)
+#define BRC_HUGE_PAGE_WASTE (8) /* a buffer is rounded up to whole huge pages only if that adds at most 1/8 of it */
+
+int brc_current_node() {
+#if defined(_WIN32) && _WIN32_WINNT >= 0x0601
+	PROCESSOR_NUMBER cpu;
+	USHORT node;
+	GetCurrentProcessorNumberEx(&cpu);
+	return GetNumaProcessorNodeEx(&cpu, &node) ? node : 0;
+#elif defined(__linux__) && defined(SYS_getcpu)
+	unsigned int cpu, node;
+	return syscall(SYS_getcpu, &cpu, &node, NULL) == 0 ? (int)node : 0;
+#else
+	return 0;
+#endif
+}
+
+/* bytes actually mapped for 'bytes', the same on allocation and release; a 1MB block would double on a whole huge page, so it stays on small ones */
+static size_t brc_mapped_size(size_t bytes) {
+	size_t huge = (bytes + BRC_HUGE_PAGE_SIZE - 1) / BRC_HUGE_PAGE_SIZE * BRC_HUGE_PAGE_SIZE;
+	if(bytes > 0 && huge - bytes <= bytes / BRC_HUGE_PAGE_WASTE) return huge;
+	return (bytes + BRC_PAGE_SIZE - 1) / BRC_PAGE_SIZE * BRC_PAGE_SIZE + (bytes == 0 ? BRC_PAGE_SIZE : 0);
+}
+
+static void brc_first_touch(void * ptr, size_t size) {
+	volatile unsigned char * p = (volatile unsigned char*)ptr;
+	for(size_t i = 0; i < size; i += BRC_PAGE_SIZE)
+		p[i] = 0;
+}
+
+static void * brc_page_alloc(brc_allocator_s * allocator, size_t bytes) {
+	int pages = (int)(size_t)allocator->opaque;
+	if(pages == BRC_PAGES_SMALL) return brc_aligned_malloc(bytes, BRC_CACHE_LINE);
+	size_t size = brc_mapped_size(bytes);
+	void * ptr = NULL;
+#ifdef _WIN32
+	SIZE_T large = GetLargePageMinimum();
+	if(pages == BRC_PAGES_HUGE && large > 0 && size % large == 0)
+		ptr = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if(ptr == NULL) ptr = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if(ptr == NULL) return NULL;
+#elif defined(__linux__) || defined(__APPLE__)
+#ifdef MAP_HUGETLB
+	if(pages == BRC_PAGES_HUGE && size % BRC_HUGE_PAGE_SIZE == 0) {
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(ptr == MAP_FAILED) ptr = NULL;
+	}
+#endif
+	/* without reserved huge pages, over map by one and trim both ends so transparent ones can back the buffer, all but a short tail of it */
+	if(ptr == NULL) {
+		size_t slack = size >= BRC_HUGE_PAGE_SIZE ? BRC_HUGE_PAGE_SIZE : 0;
+		unsigned char * base = (unsigned char*)mmap(NULL, size + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(base == (unsigned char*)MAP_FAILED) return NULL;
+		unsigned char * aligned = slack ? base + (BRC_HUGE_PAGE_SIZE - (size_t)base % BRC_HUGE_PAGE_SIZE) % BRC_HUGE_PAGE_SIZE : base;
+		if(aligned > base) munmap(base, aligned - base);
+		if(aligned + size < base + size + slack) munmap(aligned + size, base + size + slack - (aligned + size));
+		ptr = aligned;
+#ifdef MADV_HUGEPAGE
+		if(slack) madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+	}
+#else
+	ptr = brc_aligned_malloc(size, BRC_PAGE_SIZE);
+	if(ptr == NULL) return NULL;
+#endif
+	brc_first_touch(ptr, size);
+	return ptr;
+}
+
+static void brc_page_free(brc_allocator_s * allocator, void * ptr, size_t bytes) {
+	int pages = (int)(size_t)allocator->opaque;
+	if(pages == BRC_PAGES_SMALL) { brc_aligned_free(ptr); return; }
+#ifdef _WIN32
+	(void)bytes;
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#elif defined(__linux__) || defined(__APPLE__)
+	munmap(ptr, brc_mapped_size(bytes));
+#else
+	(void)bytes;
+	brc_aligned_free(ptr);
+#endif
+}
+
+static brc_allocator_s brc_page_allocators[3] = {
+	{ brc_page_alloc, brc_page_free, (void*)BRC_PAGES_SMALL },
+	{ brc_page_alloc, brc_page_free, (void*)BRC_PAGES_THP },
+	{ brc_page_alloc, brc_page_free, (void*)BRC_PAGES_HUGE },
+};
+
+brc_allocator_s * brc_page_allocator(int pages) {
+	return &brc_page_allocators[pages >= BRC_PAGES_SMALL && pages <= BRC_PAGES_HUGE ? pages : BRC_PAGES_SMALL];
+}
+
+struct brc_pooled_s {
+	void * ptr;
+	size_t bytes;
+	int node;
+};
+
+struct brc_pool_s {
+	brc_allocator_s allocator; /* handed out, 'opaque' points back here */
+	brc_allocator_s * backing;
+	std::mutex lock;
+	std::vector<brc_pooled_s> idle, live;
+};
+
+static void * brc_pool_alloc(brc_allocator_s * allocator, size_t bytes) {
+	brc_pool_s * pool = (brc_pool_s*)allocator->opaque;
+	int node = brc_current_node();
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		for(size_t i = 0; i < pool->idle.size(); i++) {
+			if(pool->idle[i].bytes != bytes || pool->idle[i].node != node) continue;
+			brc_pooled_s buffer = pool->idle[i];
+			pool->idle[i] = pool->idle.back();
+			pool->idle.pop_back();
+			pool->live.push_back(buffer);
+			return buffer.ptr;
+		}
+	}
+	/* mapped and touched outside the lock, the other threads' contexts need not wait on it */
+	brc_pooled_s buffer = { pool->backing->alloc(pool->backing, bytes), bytes, node };
+	if(buffer.ptr == NULL) return NULL;
+	std::lock_guard<std::mutex> guard(pool->lock);
+	pool->live.push_back(buffer);
+	return buffer.ptr;
+}
+
+/* a freed buffer stays idle while another of its size is live; the last one releases every idle buffer of that size, so contexts that grow leave nothing behind */
+static void brc_pool_free(brc_allocator_s * allocator, void * ptr, size_t bytes) {
+	brc_pool_s * pool = (brc_pool_s*)allocator->opaque;
+	std::vector<brc_pooled_s> released;
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		size_t i = 0;
+		while(i < pool->live.size() && pool->live[i].ptr != ptr) i++;
+		if(i == pool->live.size()) {
+			pool->backing->free(pool->backing, ptr, bytes);
+			return;
+		}
+		brc_pooled_s buffer = pool->live[i];
+		pool->live[i] = pool->live.back();
+		pool->live.pop_back();
+		bool in_use = false;
+		for(i = 0; i < pool->live.size() && !in_use; i++)
+			in_use = pool->live[i].bytes == buffer.bytes;
+		if(in_use) {
+			pool->idle.push_back(buffer);
+			return;
+		}
+		released.push_back(buffer);
+		for(i = 0; i < pool->idle.size(); ) {
+			if(pool->idle[i].bytes != buffer.bytes) { i++; continue; }
+			released.push_back(pool->idle[i]);
+			pool->idle[i] = pool->idle.back();
+			pool->idle.pop_back();
+		}
+	}
+	for(size_t i = 0; i < released.size(); i++)
+		pool->backing->free(pool->backing, released[i].ptr, released[i].bytes);
+}
+
+brc_allocator_s * brc_pool_create(brc_allocator_s * backing) {
+	brc_pool_s * pool = new brc_pool_s;
+	pool->allocator.alloc = brc_pool_alloc;
+	pool->allocator.free = brc_pool_free;
+	pool->allocator.opaque = pool;
+	pool->backing = backing ? backing : brc_page_allocator(BRC_PAGES_SMALL);
+	return &pool->allocator;
+}
+
+void brc_pool_destroy(brc_allocator_s * allocator) {
+	brc_pool_s * pool = (brc_pool_s*)allocator->opaque;
+	for(size_t i = 0; i < pool->idle.size(); i++)
+		pool->backing->free(pool->backing, pool->idle[i].ptr, pool->idle[i].bytes);
+	delete pool;
+}
+
+/* little endian base 128, 7 bits per byte with the top bit set on all but the last */
+inline size_t brc_varint_size(uint64_t x) {
+	size_t n = 1;
+	while(x >= 0x80) x >>= 7, n++;
+	return n;
+}
+
+inline unsigned char * brc_put_varint(unsigned char * dst, uint64_t x) {
+	while(x >= 0x80) {
+		*dst++ = (x & 0x7f) | 0x80;
+		x >>= 7;
+	}
+	*dst++ = x;
+	return dst;
+}
+
+/* returns NULL if the number runs past 'end' or does not fit 64 bits */
+inline unsigned char * brc_get_varint(unsigned char * src, unsigned char * end, uint64_t * x) {
+	uint64_t v = 0;
+	for(size_t shift = 0; src < end && shift < 64; shift += 7) {
+		unsigned char c = *src++;
+		v |= (uint64_t)(c & 0x7f) << shift;
+		if(c < 0x80) return *x = v, src;
+	}
+	return NULL;
+}
+
+#ifdef BRC_STATS
+/* time stamp counter where there is one, else nanoseconds */
+inline uint64_t brc_cycles() {
+#ifdef BRC_X86
+	return __rdtsc();
+#else
+	return (uint64_t)(omp_get_wtime() * 1e9);
+#endif
+}
+#endif
+
+bool brc_stats_enabled() {
+#ifdef BRC_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*** bytewise zero run length coder  ***/
+/*
+	Ranks 1..0xfd are stored plus one, 0xfe and 0xff as 0xff followed by a 0 or 1 byte, and a run of n
+	zeros as the bits of n + 1 below its top bit, one 0 or 1 byte each. Bytes 0 and 1 outside an escape
+	therefore always belong to a run. The SIMD versions copy spans of plain ranks a vector at a time and
+	find the end of zero runs with compare and movemask, only the run headers and escapes are bytewise.
+*/
+/* index of the highest set bit of a nonzero 'x' */
+inline size_t brc_bsr(uint64_t x) {
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(x);
+#elif defined(_MSC_VER)
+	unsigned long i;
+	_BitScanReverse64(&i, x);
+	return i;
+#else
+	size_t i = 0;
+	while(x >>= 1) i++;
+	return i;
+#endif
+}
+
+/* index of the lowest set bit of a nonzero 'x' */
+inline size_t brc_ctz(uint64_t x) {
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#elif defined(_MSC_VER)
+	unsigned long i;
+	_BitScanForward64(&i, x);
+	return i;
+#else
+	size_t i = 0;
+	while(!(x & 1)) x >>= 1, i++;
+	return i;
+#endif
+}
+
+/* number of set bits of 'x' */
+inline size_t brc_popcount(uint64_t x) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ull);
+	x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (x * 0x0101010101010101ull) >> 56;
+#endif
+}
+
+/* codes the token at src[i], a zero run of 'run' bytes when run > 0; returns the new write head */
+inline unsigned char * rlt_put_token(unsigned char * src, size_t i, size_t run, unsigned char * write_head) {
+	if(run > 0) {
+		size_t L = run + 1;
+		size_t msb = brc_bsr(L);
+		while(msb--)
+			*write_head++ = (L >> msb) & 1;
+	} else if (src[i] >= 0xfe) {
+		*write_head++ = 0xff;
+		*write_head++ = src[i] == 0xff;
+	} else {
+		*write_head++ = src[i] + 1;
+	}
+	return write_head;
+}
+
+/* the coded block ends in its descriptor byte, ranks that would not shrink are stored as they are */
+inline size_t rlt_finish(unsigned char * src, unsigned char * dst, size_t size, size_t i, unsigned char * write_head) {
+	if(i < size) {
+		brc_memcopy_separate(dst, src, size);
+		*(dst + size) = 0;
+		return size + BRC_RLT_FOOTER_SIZE;
+	} else {
+		size_t packed_size = write_head - dst;
+		*(dst + packed_size) = 1;
+		return packed_size + BRC_RLT_FOOTER_SIZE;
+	}
+}
+
+size_t rlt_forwards_std(unsigned char * src, unsigned char * dst, size_t size) {
+	unsigned char * write_head = dst;
+	unsigned char * write_end = write_head + size;
+	size_t i = 0;
+	while(i < size && write_head < write_end) {	
+		size_t run = 0;
+		while ((i + run) < size && src[i + run] == 0)
+			run++;
+		write_head = rlt_put_token(src, i, run, write_head);
+		i += run ? run : 1;
+	}
+	return rlt_finish(src, dst, size, i, write_head);
+}
+
+/* returns the number of bytes written, or 0 if the stream is malformed or would overflow 'dst_capacity' */
+size_t rlt_reverse_std(unsigned char * src, unsigned char * dst, size_t size, size_t dst_capacity) {
+	unsigned char * write_head = dst;
+	unsigned char * write_end = write_head + dst_capacity;
+	size_t i = 0; 
+	while(i < size && write_head < write_end) {
+		if(src[i] == 0xff) {
+			if(i + 1 == size) return 0;
+			*write_head++ = 0xfe + src[i + 1];
+			i += 2;
+		} else if (src[i] > 1) {
+			*write_head++ = src[i++] - 1;
+		} else {
+			size_t rle = 1, bits = 0;
+			while (i < size && src[i] <= 1 && bits++ < 63)
+				rle = (rle << 1) | src[i++];
+			rle -= 1;
+			if(rle > (size_t)(write_end - write_head)) return 0;
+			memset(write_head, 0, rle);
+			write_head += rle;
+		}
+	}
+	return i < size ? 0 : write_head - dst;
+}
+
+#ifdef BRC_X86
+/*
+	A vector of plain ranks is stored plus one in one go, up to the first byte needing more than that:
+	r - 1 >= 0xfd (unsigned) picks out 0, 0xfe and 0xff at once.
+*/
+__attribute__((target("sse2"))) size_t rlt_forwards_sse2(unsigned char * src, unsigned char * dst, size_t size) {
+	const __m128i one = _mm_set1_epi8(1), top = _mm_set1_epi8((char)0xfd), zero = _mm_setzero_si128();
+	unsigned char * write_head = dst;
+	unsigned char * write_end = write_head + size;
+	size_t i = 0;
+	while(i < size && write_head < write_end) {
+		size_t run = 0;
+		if(i + 16 <= size && write_head + 16 <= write_end) {
+			__m128i v = _mm_loadu_si128((__m128i*)&src[i]);
+			__m128i t = _mm_sub_epi8(v, one);
+			unsigned int special = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(t, top), t));
+			_mm_storeu_si128((__m128i*)write_head, _mm_add_epi8(v, one));
+			size_t n = special ? brc_ctz(special) : 16;
+			i += n, write_head += n;
+			if(n == 16) continue;
+
+			/* a run ending within the same vector needs no second load */
+			unsigned int rest = (~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xffff) >> n;
+			if(src[i] == 0 && rest) {
+				run = brc_ctz(rest);
+				write_head = rlt_put_token(src, i, run, write_head);
+				i += run;
+				continue;
+			}
+		}
+
+		while(i + run + 16 <= size) {
+			unsigned int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)&src[i + run]), zero));
+			if(zeros != 0xffff) {
+				run += brc_ctz(~zeros);
+				break;
+			}
+			run += 16;
+		}
+		if(i + run + 16 > size)
+			while ((i + run) < size && src[i + run] == 0)
+				run++;
+		write_head = rlt_put_token(src, i, run, write_head);
+		i += run ? run : 1;
+	}
+	return rlt_finish(src, dst, size, i, write_head);
+}
+
+/* the same test on b - 2 finds 0, 1 and 0xff, the bytes that end a span of plain ranks */
+__attribute__((target("sse2"))) size_t rlt_reverse_sse2(unsigned char * src, unsigned char * dst, size_t size, size_t dst_capacity) {
+	const __m128i one = _mm_set1_epi8(1), two = _mm_set1_epi8(2), top = _mm_set1_epi8((char)0xfd);
+	unsigned char * write_head = dst;
+	unsigned char * write_end = write_head + dst_capacity;
+	size_t i = 0; 
+	while(i < size && write_head < write_end) {
+		if(i + 16 <= size && write_head + 16 <= write_end) {
+			__m128i v = _mm_loadu_si128((__m128i*)&src[i]);
+			__m128i t = _mm_sub_epi8(v, two);
+			unsigned int special = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(t, top), t));
+			_mm_storeu_si128((__m128i*)write_head, _mm_sub_epi8(v, one));
+			size_t n = special ? brc_ctz(special) : 16;
+			i += n, write_head += n;
+			if(n == 16 || i == size) continue;
+
+			/* a run header of up to 8 bytes ending within the vector is read from its masks, the bits reversed by multiplication */
+			unsigned int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, one), v)) >> n;
+			unsigned int ones = _mm_movemask_epi8(_mm_cmpeq_epi8(v, one)) >> n;
+			size_t k = brc_ctz(~bits);
+			if(bits & 1 && k <= 8 && n + k < 16) {
+				uint64_t b = ((((ones & 0xff) * 0x80200802ULL) & 0x0884422110ULL) * 0x0101010101ULL >> 32) & 0xff;
+				size_t rle = (((size_t)1 << k) | (b >> (8 - k))) - 1;
+				if(rle > (size_t)(write_end - write_head)) return 0;
+				if(rle <= 16 && write_head + 16 <= write_end) _mm_storeu_si128((__m128i*)write_head, _mm_setzero_si128());
+				else memset(write_head, 0, rle);
+				write_head += rle;
+				i += k;
+				continue;
+			}
+		}
+
+		if(src[i] == 0xff) {
+			if(i + 1 == size) return 0;
+			*write_head++ = 0xfe + src[i + 1];
+			i += 2;
+		} else if (src[i] > 1) {
+			*write_head++ = src[i++] - 1;
+		} else {
+			size_t rle = 1, bits = 0;
+			while (i < size && src[i] <= 1 && bits++ < 63)
+				rle = (rle << 1) | src[i++];
+			rle -= 1;
+			if(rle > (size_t)(write_end - write_head)) return 0;
+			if(rle <= 16 && write_head + 16 <= write_end) _mm_storeu_si128((__m128i*)write_head, _mm_setzero_si128());
+			else memset(write_head, 0, rle);
+			write_head += rle;
+		}
+	}
+	return i < size ? 0 : write_head - dst;
+}
+#endif
+
+/*
+	Size rlt_forwards would code 'size' ranks to, without writing them: its output, or the ranks as they
+	are when that is not smaller. With 'entropy' set it is the order-0 entropy of that in bytes instead.
+*/
+double rlt_estimate(unsigned char * src, size_t size, int entropy) {
+	uint64_t coded[256] = {0}, plain[256] = {0};
+	size_t coded_size = 0, i = 0;
+	while(i < size) {
+		if(src[i] == 0) {
+			size_t run = 1;
+			while ((i + run) < size && src[i + run] == 0)
+				run++;
+			plain[0] += run;
+			size_t L = run + 1, msb = brc_bsr(L);
+			while(msb--)
+				coded[(L >> msb) & 1]++, coded_size++;
+			i += run;
+		} else {
+			plain[src[i]]++;
+			if(src[i] >= 0xfe) coded[0xff]++, coded[src[i] == 0xff]++, coded_size += 2;
+			else coded[src[i] + 1]++, coded_size++;
+			i++;
+		}
+	}
+	uint64_t * freqs = coded_size < size ? coded : plain;
+	size_t n = coded_size < size ? coded_size : size;
+	if(!entropy || n == 0) return n;
+	double bits = 0;
+	for(size_t c = 0; c < 256; c++)
+		if(freqs[c] > 0) bits += freqs[c] * log2((double)n / freqs[c]);
+	return bits / 8;
+}
+
+#ifdef BRC_STATS
+/* walks the input of rlt_forwards the way it codes it, counting runs by their coded length and the escaped ranks */
+void rlt_stats(unsigned char * src, size_t size, brc_stats_s * stats) {
+	size_t i = 0;
+	while(i < size) {
+		if(src[i] == 0) {
+			size_t run = 1;
+			while ((i + run) < size && src[i + run] == 0)
+				run++;
+			i += run;
+			size_t L = run + 1, bytes = 0;
+			while(L >>= 1) bytes++;
+			stats->zero_runs[bytes <= 64 ? bytes - 1 : 63]++;
+		} else {
+			stats->escapes_fe += src[i] == 0xfe;
+			stats->escapes_ff += src[i] == 0xff;
+			i++;
+		}
+	}
+}
+#endif
+
+/*** vectorized sorted rank transform ***/
+struct alignas(64) vmtf_s {
+	unsigned char map[256 + 64]; /* tail is padding so the vector shifts can load one chunk past rank 255 */
+};
+
+inline void init_vmtf(vmtf_s * x) {
+	for(size_t i = 0; i < sizeof(x->map); i++)
+		x->map[i] = i;
+}
+
+inline void inverse_vmtf_update_only(vmtf_s * x, unsigned char r, unsigned char s) {
+	size_t j = 0;
+	do x->map[j] = x->map[j + 1];
+	while(++j < r);
+	x->map[r] = s;
+}
+
+inline unsigned char inverse_vmtf_update_single(vmtf_s * x, unsigned char r, unsigned char s) {
+	inverse_vmtf_update_only(x, r, s);
+	return x->map[0];
+}
+
+static int brc_compare_keys(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x < y) - (x > y);
+}
+
+/* present symbols by descending frequency, ties go to the smaller symbol; one sort of packed keys instead of a scan per symbol */
+inline size_t generate_sorted_map(uint64_t * freqs, unsigned char * map) {
+	uint64_t keys[256];
+	size_t n = 0;
+	for(size_t i = 0; i < 256; i++)
+		if(freqs[i] > 0) 
+			keys[n++] = ((uint64_t)freqs[i] << 8) | (255 - i);
+	qsort(keys, n, sizeof(keys[0]), brc_compare_keys);
+	for(size_t i = 0; i < n; i++)
+		map[i] = 255 - (keys[i] & 0xff);
+	return n;
+}
+
+/* symbols of the shared table first, in its order, then any it lacks by symbol */
+inline size_t generate_shared_map(uint64_t * freqs, brc_shared_s * shared, unsigned char * map) {
+	bool used[256] = {false};
+	size_t n = 0;
+	int num_symbols = shared->num_symbols < 256 ? shared->num_symbols : 256;
+	for(int i = 0; i < num_symbols; i++) {
+		unsigned char s = shared->order[i];
+		if(freqs[s] > 0 && !used[s]) 
+			used[s] = true, map[n++] = s;
+	}
+	for(size_t i = 0; i < 256; i++)
+		if(freqs[i] > 0 && !used[i]) 
+			map[n++] = i;
+	return n;
+}
+
+/* order of the buckets; both sides must pass the same shared table */
+inline size_t generate_bucket_map(uint64_t * freqs, brc_shared_s * shared, unsigned char * map) {
+	return shared ? generate_shared_map(freqs, shared, map) : generate_sorted_map(freqs, map);
+}
+
+/*
+	The frequency table closes a ranked block. Small blocks carry few symbols with small counts, so it is
+	written as a bitmap of present symbols followed by their counts as varints and the size of the whole
+	header, whenever that beats the full table of 256 counts. Counts past 32 bits only fit the compact form.
+*/
+size_t vsrc_write_footer(unsigned char * dst, uint64_t * freqs, int * flags) {
+	size_t compact_size = BRC_BITMAP_SIZE + sizeof(uint16_t);
+	bool wide = false;
+	for(size_t i = 0; i < 256; i++) {
+		if(freqs[i] > 0) 
+			compact_size += brc_varint_size(freqs[i]);
+		wide |= freqs[i] > UINT32_MAX;
+	}
+
+	if(compact_size >= BRC_VSRC_FOOTER_SIZE && !wide) {
+		uint32_t table[256];
+		for(size_t i = 0; i < 256; i++)
+			table[i] = freqs[i];
+		brc_memcopy_separate(dst, table, BRC_VSRC_FOOTER_SIZE);
+		return BRC_VSRC_FOOTER_SIZE;
+	}
+
+	unsigned char * write_head = dst + BRC_BITMAP_SIZE;
+	memset(dst, 0, BRC_BITMAP_SIZE);
+	for(size_t i = 0; i < 256; i++) {
+		if(freqs[i] == 0) continue;
+		dst[i >> 3] |= 1 << (i & 7);
+		write_head = brc_put_varint(write_head, freqs[i]);
+	}
+	uint16_t footer_size = compact_size;
+	memcpy(write_head, &footer_size, sizeof(footer_size));
+	*flags |= BRC_BLOCK_COMPACT;
+	return compact_size;
+}
+
+/* largest compact table: the bitmap, 256 counts of up to 10 bytes and its size */
+#define BRC_COMPACT_FOOTER_MAX (BRC_BITMAP_SIZE + 256 * 10 + sizeof(uint16_t))
+
+/* reads the frequency table ending at 'end' with 'available' bytes before it, counts can be up to 'src_size' */
+size_t vsrc_parse_footer(unsigned char * end, size_t available, size_t src_size, int flags, uint64_t * freqs) {
+	if(!(flags & BRC_BLOCK_COMPACT)) {
+		uint32_t table[256];
+		if(available < BRC_VSRC_FOOTER_SIZE) return 0;
+		brc_memcopy_separate(table, end - BRC_VSRC_FOOTER_SIZE, BRC_VSRC_FOOTER_SIZE);
+		for(size_t i = 0; i < 256; i++)
+			freqs[i] = table[i];
+		return BRC_VSRC_FOOTER_SIZE;
+	}
+
+	uint16_t footer_size;
+	if(available < BRC_BITMAP_SIZE + sizeof(footer_size)) return 0;
+	memcpy(&footer_size, end - sizeof(footer_size), sizeof(footer_size));
+	if(footer_size < BRC_BITMAP_SIZE + sizeof(footer_size) || footer_size > available) return 0;
+
+	unsigned char * bitmap = end - footer_size;
+	unsigned char * read_head = bitmap + BRC_BITMAP_SIZE, * read_end = end - sizeof(footer_size);
+	for(size_t i = 0; i < 256; i++) {
+		uint64_t count = 0;
+		if(bitmap[i >> 3] & (1 << (i & 7))) {
+			read_head = brc_get_varint(read_head, read_end, &count);
+			if(read_head == NULL || count == 0 || count > src_size) return 0;
+		}
+		freqs[i] = count;
+	}
+	return read_head == read_end ? footer_size : 0;
+}
+
+/* reads the frequency table at the end of 'src'; returns its size, or 0 if it is malformed */
+size_t vsrc_read_footer(unsigned char * src, size_t src_size, int flags, uint64_t * freqs) {
+	return vsrc_parse_footer(src + src_size, src_size, src_size, flags, freqs);
+}
+
+/* every rank below 'r' moves back by one, generic version for any target */
+inline void forward_vmtf_update_std(vmtf_s * x, unsigned char r) {
+	for(size_t i = 0; i < 256; i++)
+		x->map[i] += (x->map[i] < r);
+}
+
+void vsrc_ranks_std(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state) {
+	for(size_t i = 0; i < src_size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[bucket[s]++] = r;
+		if(r) {
+			forward_vmtf_update_std(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+
+#ifdef BRC_X86
+/* x < r is computed as min(x, r - 1) == x since there is no unsigned byte compare before AVX-512 */
+__attribute__((target("sse2"))) inline void forward_vmtf_update_sse2(vmtf_s * x, unsigned char r) {
+	const __m128i rv = _mm_set1_epi8((char)(r - 1));
+	for(size_t i = 0; i < 256; i += 16) {
+		__m128i v = _mm_load_si128((__m128i*)&x->map[i]);
+		__m128i lt = _mm_cmpeq_epi8(_mm_min_epu8(v, rv), v);
+		_mm_store_si128((__m128i*)&x->map[i], _mm_sub_epi8(v, lt));
+	}
+}
+
+__attribute__((target("avx2"))) inline void forward_vmtf_update_avx2(vmtf_s * x, unsigned char r) {
+	const __m256i rv = _mm256_set1_epi8((char)(r - 1));
+	for(size_t i = 0; i < 256; i += 32) {
+		__m256i v = _mm256_load_si256((__m256i*)&x->map[i]);
+		__m256i lt = _mm256_cmpeq_epi8(_mm256_min_epu8(v, rv), v);
+		_mm256_store_si256((__m256i*)&x->map[i], _mm256_sub_epi8(v, lt));
+	}
+}
+
+__attribute__((target("avx512bw"))) inline void forward_vmtf_update_avx512(vmtf_s * x, unsigned char r) {
+	const __m512i rv = _mm512_set1_epi8((char)r);
+	const __m512i one = _mm512_set1_epi8(1);
+	for(size_t i = 0; i < 256; i += 64) {
+		__m512i v = _mm512_load_si512((__m512i*)&x->map[i]);
+		__mmask64 lt = _mm512_cmplt_epu8_mask(v, rv);
+		_mm512_store_si512((__m512i*)&x->map[i], _mm512_mask_add_epi8(v, lt, v, one));
+	}
+}
+
+__attribute__((target("sse2"))) void vsrc_ranks_sse2(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state) {
+	for(size_t i = 0; i < src_size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[bucket[s]++] = r;
+		if(r) {
+			forward_vmtf_update_sse2(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+
+__attribute__((target("avx2"))) void vsrc_ranks_avx2(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state) {
+	for(size_t i = 0; i < src_size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[bucket[s]++] = r;
+		if(r) {
+			forward_vmtf_update_avx2(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+
+__attribute__((target("avx512bw"))) void vsrc_ranks_avx512(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state) {
+	for(size_t i = 0; i < src_size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[bucket[s]++] = r;
+		if(r) {
+			forward_vmtf_update_avx512(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+#endif
+
+/* ranks are read from the bucket of the current symbol, which then moves back to position 'r' */
+void vsrc_symbols_std(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size; i++) {
+		dst[i] = s, r = 0xff;
+		if(bucket[s] < bucket_end[s]) r = src[bucket[s]++];
+		if(r) s = inverse_vmtf_update_single(state, r, s);
+	}
+}
+
+#ifdef BRC_X86
+/*
+	The inverse update is a rotate of map[0..r] left by one byte. Each chunk is built from two aligned
+	loads so the loads always line up with the previous symbol's stores and can be forwarded. Positions
+	and r are offset by 0x80 so a signed compare orders them as unsigned bytes, which also makes r = 0
+	leave the map as it is; the interleaved kernels rely on that to skip the branch on r.
+*/
+__attribute__((target("sse2"))) inline unsigned char inverse_vmtf_update_sse2(vmtf_s * x, unsigned char r, unsigned char s) {
+	const __m128i rv = _mm_set1_epi8((char)(r ^ 0x80));
+	const __m128i sv = _mm_set1_epi8((char)s);
+	__m128i idx = _mm_setr_epi8(-128, -127, -126, -125, -124, -123, -122, -121, -120, -119, -118, -117, -116, -115, -114, -113);
+	__m128i v = _mm_load_si128((__m128i*)&x->map[0]);
+	__m128i front = v;
+	size_t i = 0;
+	do {
+		__m128i next = _mm_load_si128((__m128i*)&x->map[i + 16]);
+		__m128i sh = _mm_or_si128(_mm_srli_si128(v, 1), _mm_slli_si128(next, 15));
+		__m128i lt = _mm_cmpgt_epi8(rv, idx);
+		__m128i eq = _mm_cmpeq_epi8(idx, rv);
+		__m128i res = _mm_or_si128(_mm_and_si128(lt, sh), _mm_andnot_si128(lt, v));
+		res = _mm_or_si128(_mm_and_si128(eq, sv), _mm_andnot_si128(eq, res));
+		_mm_store_si128((__m128i*)&x->map[i], res);
+		if(i == 0) front = res;
+		idx = _mm_add_epi8(idx, _mm_set1_epi8(16));
+		v = next;
+		i += 16;
+	} while(i <= r);
+	return (unsigned char)_mm_cvtsi128_si32(front);
+}
+
+__attribute__((target("avx2"))) inline unsigned char inverse_vmtf_update_avx2(vmtf_s * x, unsigned char r, unsigned char s) {
+	const __m256i rv = _mm256_set1_epi8((char)(r ^ 0x80));
+	const __m256i sv = _mm256_set1_epi8((char)s);
+	__m256i idx = _mm256_setr_epi8(-128, -127, -126, -125, -124, -123, -122, -121, -120, -119, -118, -117, -116, -115, -114, -113,
+		-112, -111, -110, -109, -108, -107, -106, -105, -104, -103, -102, -101, -100, -99, -98, -97);
+	__m256i v = _mm256_load_si256((__m256i*)&x->map[0]);
+	__m256i front = v;
+	size_t i = 0;
+	do {
+		__m256i next = _mm256_load_si256((__m256i*)&x->map[i + 32]);
+		__m256i sh = _mm256_alignr_epi8(_mm256_permute2x128_si256(v, next, 0x21), v, 1);
+		__m256i res = _mm256_blendv_epi8(v, sh, _mm256_cmpgt_epi8(rv, idx));
+		res = _mm256_blendv_epi8(res, sv, _mm256_cmpeq_epi8(idx, rv));
+		_mm256_store_si256((__m256i*)&x->map[i], res);
+		if(i == 0) front = res;
+		idx = _mm256_add_epi8(idx, _mm256_set1_epi8(32));
+		v = next;
+		i += 32;
+	} while(i <= r);
+	return (unsigned char)_mm256_cvtsi256_si32(front);
+}
+
+__attribute__((target("avx512bw"))) inline unsigned char inverse_vmtf_update_avx512(vmtf_s * x, unsigned char r, unsigned char s) {
+	const __m512i rv = _mm512_set1_epi8((char)r);
+	const __m512i base = _mm512_set_epi8(
+		63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48,
+		47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32,
+		31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	__m512i idx = base;
+	__m512i v = _mm512_load_si512((__m512i*)&x->map[0]);
+	__m512i front = v;
+	size_t i = 0;
+	do {
+		__m512i next = _mm512_load_si512((__m512i*)&x->map[i + 64]);
+		__m512i sh = _mm512_alignr_epi8(_mm512_alignr_epi32(next, v, 4), v, 1);
+		__m512i res = _mm512_mask_blend_epi8(_mm512_cmplt_epu8_mask(idx, rv), v, sh);
+		res = _mm512_mask_set1_epi8(res, _mm512_cmpeq_epi8_mask(idx, rv), (char)s);
+		_mm512_store_si512((__m512i*)&x->map[i], res);
+		if(i == 0) front = res;
+		idx = _mm512_add_epi8(idx, _mm512_set1_epi8(64));
+		v = next;
+		i += 64;
+	} while(i <= r);
+	return (unsigned char)_mm_cvtsi128_si32(_mm512_castsi512_si128(front));
+}
+
+__attribute__((target("sse2"))) void vsrc_symbols_sse2(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size; i++) {
+		dst[i] = s, r = 0xff;
+		if(bucket[s] < bucket_end[s]) r = src[bucket[s]++];
+		if(r) s = inverse_vmtf_update_sse2(state, r, s);
+	}
+}
+
+__attribute__((target("avx2"))) void vsrc_symbols_avx2(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size; i++) {
+		dst[i] = s, r = 0xff;
+		if(bucket[s] < bucket_end[s]) r = src[bucket[s]++];
+		if(r) s = inverse_vmtf_update_avx2(state, r, s);
+	}
+}
+
+__attribute__((target("avx512bw"))) void vsrc_symbols_avx512(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size; i++) {
+		dst[i] = s, r = 0xff;
+		if(bucket[s] < bucket_end[s]) r = src[bucket[s]++];
+		if(r) s = inverse_vmtf_update_avx512(state, r, s);
+	}
+}
+#endif
+
+/*** narrow alphabet kernels ***/
+/*
+	Blocks of at most 16, 32 or 64 symbols run kernels specialized on that width, which keep the ranks
+	in registers and touch only live lanes. The encoder gives each symbol the lane of its initial rank
+	and keeps the current ranks by lane, so a symbol's rank is a single in-register lookup. The decoder
+	keeps the symbols by rank as the full kernels do. A symbol that does not occur again goes to the
+	last lane instead of rank 0xff; valid ranks are always below the block's symbol count.
+*/
+#define VSRC_NARROW (3)
+
+static const size_t vsrc_narrow_width[VSRC_NARROW] = { 16, 32, 64 };
+
+/* narrowest class holding 'unique_syms' symbols, VSRC_NARROW if only the full kernels do */
+inline size_t vsrc_narrow_class(size_t unique_syms) {
+	size_t c = 0;
+	while(c < VSRC_NARROW && vsrc_narrow_width[c] < unique_syms) c++;
+	return c;
+}
+
+template<size_t W> void vsrc_ranks_narrow_std(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state) {
+	unsigned char ranks[W];
+	for(size_t j = 0; j < W; j++)
+		ranks[j] = j;
+	for(size_t i = 0; i < src_size; i++) {
+		unsigned char s = src[i];
+		unsigned char lane = state->map[s] & (W - 1);
+		unsigned char r = ranks[lane];
+		dst[bucket[s]++] = r;
+		for(size_t j = 0; j < W; j++)
+			ranks[j] += (ranks[j] < r);
+		ranks[lane] = 0;
+	}
+}
+
+template<size_t W> void vsrc_symbols_narrow_std(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size; i++) {
+		dst[i] = s, r = W - 1;
+		if(bucket[s] < bucket_end[s]) r = src[bucket[s]++];
+		if(r >= W) r = W - 1;
+		if(r) s = inverse_vmtf_update_single(state, r, s);
+	}
+}
+
+#ifdef BRC_X86
+/*
+	Ranks are held in W / 16 registers. pshufb with a lane index broadcasts that lane of one register
+	and zeroes the rest when the index has its top bit set, so or'ing one lookup per register picks
+	the rank out of any of them.
+*/
+template<size_t W> __attribute__((target("ssse3"))) void vsrc_ranks_narrow_ssse3(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state) {
+	const size_t N = W / 16;
+	const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i fifteen = _mm_set1_epi8(15);
+	__m128i ranks[N];
+	for(size_t k = 0; k < N; k++)
+		ranks[k] = _mm_add_epi8(lanes, _mm_set1_epi8(16 * k));
+	for(size_t i = 0; i < src_size; i++) {
+		unsigned char s = src[i];
+		const __m128i lane = _mm_set1_epi8((char)(state->map[s] & (W - 1)));
+		__m128i rv = _mm_setzero_si128();
+		for(size_t k = 0; k < N; k++) {
+			__m128i idx = _mm_sub_epi8(lane, _mm_set1_epi8(16 * k));
+			idx = _mm_or_si128(idx, _mm_cmpgt_epi8(idx, fifteen));
+			rv = _mm_or_si128(rv, _mm_shuffle_epi8(ranks[k], idx));
+		}
+		for(size_t k = 0; k < N; k++) {
+			__m128i self = _mm_cmpeq_epi8(_mm_add_epi8(lanes, _mm_set1_epi8(16 * k)), lane);
+			__m128i lt = _mm_cmpgt_epi8(rv, ranks[k]);
+			ranks[k] = _mm_andnot_si128(self, _mm_sub_epi8(ranks[k], lt));
+		}
+		dst[bucket[s]++] = (unsigned char)_mm_cvtsi128_si32(rv);
+	}
+}
+
+/* the symbols by rank in W / 16 registers, lanes below r take the next lane and lane r the current symbol */
+template<size_t W> __attribute__((target("ssse3"))) void vsrc_symbols_narrow_ssse3(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state) {
+	const size_t N = W / 16;
+	const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i v[N];
+	for(size_t k = 0; k < N; k++)
+		v[k] = _mm_load_si128((__m128i*)&state->map[16 * k]);
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size; i++) {
+		dst[i] = s, r = W - 1;
+		if(bucket[s] < bucket_end[s]) r = src[bucket[s]++];
+		if(r >= W) r = W - 1;
+		if(r) {
+			const __m128i rv = _mm_shuffle_epi8(_mm_cvtsi32_si128(r), _mm_setzero_si128());
+			const __m128i sv = _mm_set1_epi8((char)s);
+			for(size_t k = 0; k < N; k++) {
+				__m128i next = k + 1 < N ? v[k + 1] : _mm_setzero_si128();
+				__m128i idx = _mm_add_epi8(lanes, _mm_set1_epi8(16 * k));
+				__m128i lt = _mm_cmpgt_epi8(rv, idx), eq = _mm_cmpeq_epi8(rv, idx);
+				__m128i res = _mm_or_si128(_mm_and_si128(lt, _mm_alignr_epi8(next, v[k], 1)), _mm_andnot_si128(lt, v[k]));
+				v[k] = _mm_or_si128(_mm_and_si128(eq, sv), _mm_andnot_si128(eq, res));
+			}
+			s = (unsigned char)_mm_cvtsi128_si32(v[0]);
+		}
+	}
+}
+
+/* 64 ranks fit one register; vpermd brings the dword holding the lane to every dword and pshufb picks its byte */
+__attribute__((target("avx512bw"))) void vsrc_ranks_narrow_avx512(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state) {
+	const __m512i one = _mm512_set1_epi8(1);
+	__m512i ranks = _mm512_set_epi8(
+		63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48,
+		47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32,
+		31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	for(size_t i = 0; i < src_size; i++) {
+		unsigned char s = src[i];
+		size_t lane = state->map[s] & 63;
+		__m512i rv = _mm512_permutexvar_epi32(_mm512_set1_epi32(lane >> 2), ranks);
+		rv = _mm512_shuffle_epi8(rv, _mm512_set1_epi8((char)(lane & 3)));
+		ranks = _mm512_mask_add_epi8(ranks, _mm512_cmplt_epu8_mask(ranks, rv), ranks, one);
+		ranks = _mm512_mask_mov_epi8(ranks, (uint64_t)1 << lane, _mm512_setzero_si512());
+		dst[bucket[s]++] = (unsigned char)_mm_cvtsi128_si32(_mm512_castsi512_si128(rv));
+	}
+}
+#endif
+
+/*** interleaved unranking ***/
+/*
+	Unranking is one dependency chain per block: every symbol needs the rank list the previous one left.
+	A chain is the state of one such stream (a block or a segment), and the kernels below advance 2 to
+	BRC_MAX_INTERLEAVE chains a symbol each per step, so while one waits on its bucket load and rank list
+	update the others have work for the core. Chains keep their current symbol as map[0] between calls.
+	The SIMD kernels take no branch on the rank, so one stream's mispredictions do not throw away the
+	others' work; a spent bucket reads the byte past it, which the frequency table always provides.
+	That holds only while no chain starts past its bucket, which vsrc_reverse_segmented checks.
+*/
+struct vsrc_chain_s {
+	vmtf_s state;
+	unsigned char * src;
+	unsigned char * dst;
+	size_t size; /* symbols still to write */
+	size_t unique_syms;
+	size_t bucket[256], bucket_end[256];
+};
+
+/* advances the N chains 'steps' symbols each, every one of them must have that many left */
+template<size_t N> void vsrc_chains_std(vsrc_chain_s ** c, size_t steps) {
+	unsigned char * dst[N], s[N], r;
+	for(size_t j = 0; j < N; j++)
+		dst[j] = c[j]->dst, s[j] = c[j]->state.map[0];
+	for(size_t i = 0; i < steps; i++) {
+		for(size_t j = 0; j < N; j++) {
+			dst[j][i] = s[j], r = 0xff;
+			if(c[j]->bucket[s[j]] < c[j]->bucket_end[s[j]]) r = c[j]->src[c[j]->bucket[s[j]]++];
+			if(r) s[j] = inverse_vmtf_update_single(&c[j]->state, r, s[j]);
+		}
+	}
+}
+
+#ifdef BRC_X86
+template<size_t N> __attribute__((target("sse2"))) void vsrc_chains_sse2(vsrc_chain_s ** c, size_t steps) {
+	unsigned char * dst[N], s[N], r;
+	for(size_t j = 0; j < N; j++)
+		dst[j] = c[j]->dst, s[j] = c[j]->state.map[0];
+	for(size_t i = 0; i < steps; i++) {
+		for(size_t j = 0; j < N; j++) {
+			dst[j][i] = s[j];
+			size_t k = c[j]->bucket[s[j]];
+			bool more = k < c[j]->bucket_end[s[j]];
+			r = c[j]->src[k];
+			r = more ? r : 0xff;
+			c[j]->bucket[s[j]] = k + more;
+			s[j] = inverse_vmtf_update_sse2(&c[j]->state, r, s[j]);
+		}
+	}
+}
+
+template<size_t N> __attribute__((target("avx2"))) void vsrc_chains_avx2(vsrc_chain_s ** c, size_t steps) {
+	unsigned char * dst[N], s[N], r;
+	for(size_t j = 0; j < N; j++)
+		dst[j] = c[j]->dst, s[j] = c[j]->state.map[0];
+	for(size_t i = 0; i < steps; i++) {
+		for(size_t j = 0; j < N; j++) {
+			dst[j][i] = s[j];
+			size_t k = c[j]->bucket[s[j]];
+			bool more = k < c[j]->bucket_end[s[j]];
+			r = c[j]->src[k];
+			r = more ? r : 0xff;
+			c[j]->bucket[s[j]] = k + more;
+			s[j] = inverse_vmtf_update_avx2(&c[j]->state, r, s[j]);
+		}
+	}
+}
+
+template<size_t N> __attribute__((target("avx512bw"))) void vsrc_chains_avx512(vsrc_chain_s ** c, size_t steps) {
+	unsigned char * dst[N], s[N], r;
+	for(size_t j = 0; j < N; j++)
+		dst[j] = c[j]->dst, s[j] = c[j]->state.map[0];
+	for(size_t i = 0; i < steps; i++) {
+		for(size_t j = 0; j < N; j++) {
+			dst[j][i] = s[j];
+			size_t k = c[j]->bucket[s[j]];
+			bool more = k < c[j]->bucket_end[s[j]];
+			r = c[j]->src[k];
+			r = more ? r : 0xff;
+			c[j]->bucket[s[j]] = k + more;
+			s[j] = inverse_vmtf_update_avx512(&c[j]->state, r, s[j]);
+		}
+	}
+}
+#endif
+
+/*** fused run length and rank decoding ***/
+/*
+	Ranks which are mostly zero runs are unranked straight from the run length coded stream instead of
+	being expanded into a buffer first. Every bucket has a cursor into the stream and the number of zeros
+	it still has of the run it is in, and a run of zeros in the current symbol's bucket is that symbol
+	repeated, so it is written with one memset instead of one step per rank. A run can cross into the
+	next bucket, which starts with the rest of it. Parsing a token per rank costs more than reading an
+	expanded rank, so this only pays off when the stream is a quarter of the ranks or less; below that
+	the block is expanded as usual.
+*/
+#define VSRC_FUSED_RATIO (4)
+
+struct vsrc_cursor_s {
+	unsigned char * read_head;
+	size_t zeros; /* zeros left of the run this bucket is in, never more than 'left' */
+	size_t left; /* ranks left in this bucket */
+};
+
+/* reads the token at 'p', a rank or a run of 'run' zeros; returns the token after it, NULL past 'end' */
+inline unsigned char * rlt_next_token(unsigned char * p, unsigned char * end, unsigned char * rank, size_t * run) {
+	*run = 0;
+	if(p >= end) return NULL;
+	if(*p == 0xff) {
+		if(p + 1 == end) return NULL;
+		*rank = 0xfe + p[1];
+		return p + 2;
+	}
+	if(*p > 1) {
+		*rank = *p - 1;
+		return p + 1;
+	}
+	size_t rle = 1, bits = 0;
+	while (p < end && *p <= 1 && bits++ < 63)
+		rle = (rle << 1) | *p++;
+	*run = rle - 1;
+	*rank = 0;
+	return p;
+}
+
+/* next rank of a bucket, 0xff once it is spent or its stream is malformed */
+inline unsigned char vsrc_cursor_next(vsrc_cursor_s * c, unsigned char * end) {
+	if(c->left == 0) return 0xff;
+	c->left--;
+	if(c->zeros) return c->zeros--, 0;
+	unsigned char * p = c->read_head, rank;
+	if(p < end && (unsigned char)(*p - 2) < 0xfd) 
+		return c->read_head = p + 1, *p - 1;
+	size_t run;
+	c->read_head = rlt_next_token(p, end, &rank, &run);
+	if(c->read_head == NULL) return c->left = 0, 0xff;
+	if(run) c->zeros = run - 1 < c->left ? run - 1 : c->left;
+	return rank;
+}
+
+/* the pending zeros of the current symbol's bucket are written in one go, then the next rank moves it */
+inline size_t vsrc_fused_repeat(vsrc_cursor_s * c, unsigned char * dst, size_t i, size_t dst_size, unsigned char s) {
+	dst[i++] = s;
+	if(c->zeros) {
+		size_t z = c->zeros < dst_size - i ? c->zeros : dst_size - i;
+		memset(dst + i, s, z);
+		c->zeros -= z, c->left -= z;
+		i += z;
+	}
+	return i;
+}
+
+void vsrc_fused_std(vsrc_cursor_s * cursor, unsigned char * end, unsigned char * dst, size_t dst_size, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size;) {
+		i = vsrc_fused_repeat(&cursor[s], dst, i, dst_size, s);
+		r = vsrc_cursor_next(&cursor[s], end);
+		if(r) s = inverse_vmtf_update_single(state, r, s);
+	}
+}
+
+#ifdef BRC_X86
+__attribute__((target("sse2"))) void vsrc_fused_sse2(vsrc_cursor_s * cursor, unsigned char * end, unsigned char * dst, size_t dst_size, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size;) {
+		i = vsrc_fused_repeat(&cursor[s], dst, i, dst_size, s);
+		r = vsrc_cursor_next(&cursor[s], end);
+		if(r) s = inverse_vmtf_update_sse2(state, r, s);
+	}
+}
+
+__attribute__((target("avx2"))) void vsrc_fused_avx2(vsrc_cursor_s * cursor, unsigned char * end, unsigned char * dst, size_t dst_size, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size;) {
+		i = vsrc_fused_repeat(&cursor[s], dst, i, dst_size, s);
+		r = vsrc_cursor_next(&cursor[s], end);
+		if(r) s = inverse_vmtf_update_avx2(state, r, s);
+	}
+}
+
+__attribute__((target("avx512bw"))) void vsrc_fused_avx512(vsrc_cursor_s * cursor, unsigned char * end, unsigned char * dst, size_t dst_size, vmtf_s * state) {
+	unsigned char s = state->map[0], r;
+	for(size_t i = 0; i < dst_size;) {
+		i = vsrc_fused_repeat(&cursor[s], dst, i, dst_size, s);
+		r = vsrc_cursor_next(&cursor[s], end);
+		if(r) s = inverse_vmtf_update_avx512(state, r, s);
+	}
+}
+#endif
+
+/*** faster rank stages ***/
+/*
+	Lower levels may give a block one of these instead of the sorted rank transform. Move to front needs
+	no frequency table and its decoder reads the ranks in order, so each symbol waits only on the list
+	update of the one before it. The runs stage only turns a repeat of the previous byte into a zero so
+	the run length coder finds it, and the last stage hands the bytes to the run length coder as they are.
+	Move to front ranks come from the forward updates of the sorted rank encoder, which keep every
+	symbol's rank; the list starts as the identity on both sides.
+*/
+void mtf_ranks_std(unsigned char * src, unsigned char * dst, size_t size, vmtf_s * state) {
+	for(size_t i = 0; i < size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[i] = r;
+		if(r) {
+			forward_vmtf_update_std(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+
+#ifdef BRC_X86
+__attribute__((target("sse2"))) void mtf_ranks_sse2(unsigned char * src, unsigned char * dst, size_t size, vmtf_s * state) {
+	for(size_t i = 0; i < size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[i] = r;
+		if(r) {
+			forward_vmtf_update_sse2(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+
+__attribute__((target("avx2"))) void mtf_ranks_avx2(unsigned char * src, unsigned char * dst, size_t size, vmtf_s * state) {
+	for(size_t i = 0; i < size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[i] = r;
+		if(r) {
+			forward_vmtf_update_avx2(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+
+__attribute__((target("avx512bw"))) void mtf_ranks_avx512(unsigned char * src, unsigned char * dst, size_t size, vmtf_s * state) {
+	for(size_t i = 0; i < size; i++) {
+		unsigned char s = src[i];
+		unsigned char r = state->map[s];
+		dst[i] = r;
+		if(r) {
+			forward_vmtf_update_avx512(state, r);
+			state->map[s] = 0;
+		}
+	}
+}
+#endif
+
+/* the symbol at rank r moves to the front, a run of zeros leaves the list alone */
+void mtf_symbols(unsigned char * src, unsigned char * dst, size_t size) {
+	unsigned char list[256];
+	for(size_t i = 0; i < 256; i++)
+		list[i] = i;
+	for(size_t i = 0; i < size; i++) {
+		unsigned char r = src[i], s = list[r];
+		if(r) {
+			memmove(list + 1, list, r);
+			list[0] = s;
+		}
+		dst[i] = s;
+	}
+}
+
+/* byte 'b' after 'p' becomes 0 if it equals it, else b + 1 below it and b above it, so every value stays one byte */
+void runs_forwards(unsigned char * src, unsigned char * dst, size_t size) {
+	unsigned char p = 0;
+	for(size_t i = 0; i < size; i++) {
+		unsigned char b = src[i];
+		dst[i] = b == p ? 0 : b + (b < p);
+		p = b;
+	}
+}
+
+void runs_reverse(unsigned char * src, unsigned char * dst, size_t size) {
+	unsigned char p = 0;
+	for(size_t i = 0; i < size; i++) {
+		unsigned char r = src[i];
+		p = r == 0 ? p : r - (r <= p);
+		dst[i] = p;
+	}
+}
+
+/*** checksum ***/
+/*
+	CRC32C, the Castagnoli polynomial SSE4.2's crc32 instruction computes, so the checksums of a container
+	match whichever kernel wrote or reads them. The portable kernel goes 8 bytes at a time with 8 tables
+	(slicing by 8), the instruction takes 8 bytes per step on its own.
+*/
+#define BRC_CRC32C_POLY (0x82f63b78u) /* reflected */
+
+struct crc32c_tables_s {
+	uint32_t t[8][256];
+	crc32c_tables_s() {
+		for(uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for(int k = 0; k < 8; k++)
+				crc = (crc >> 1) ^ (BRC_CRC32C_POLY & (0 - (crc & 1)));
+			t[0][i] = crc;
+		}
+		for(size_t k = 1; k < 8; k++)
+			for(size_t i = 0; i < 256; i++)
+				t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+	}
+};
+
+uint32_t crc32c_std(uint32_t crc, const unsigned char * src, size_t size) {
+	static const crc32c_tables_s tables;
+	const uint32_t (*t)[256] = tables.t;
+	for(; size >= 8; src += 8, size -= 8) {
+		uint32_t x = crc ^ (src[0] | (uint32_t)src[1] << 8 | (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24);
+		crc = t[7][x & 0xff] ^ t[6][(x >> 8) & 0xff] ^ t[5][(x >> 16) & 0xff] ^ t[4][x >> 24]
+			^ t[3][src[4]] ^ t[2][src[5]] ^ t[1][src[6]] ^ t[0][src[7]];
+	}
+	for(; size > 0; size--)
+		crc = t[0][(crc ^ *src++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef BRC_X86
+__attribute__((target("sse4.2"))) uint32_t crc32c_sse42(uint32_t crc, const unsigned char * src, size_t size) {
+	for(; size > 0 && ((uintptr_t)src & 7); size--)
+		crc = _mm_crc32_u8(crc, *src++);
+#ifdef __x86_64__
+	uint64_t crc64 = crc;
+	for(; size >= 8; src += 8, size -= 8) {
+		uint64_t x;
+		memcpy(&x, src, sizeof(x));
+		crc64 = _mm_crc32_u64(crc64, x);
+	}
+	crc = (uint32_t)crc64;
+#endif
+	for(; size >= 4; src += 4, size -= 4) {
+		uint32_t x;
+		memcpy(&x, src, sizeof(x));
+		crc = _mm_crc32_u32(crc, x);
+	}
+	for(; size > 0; size--)
+		crc = _mm_crc32_u8(crc, *src++);
+	return crc;
+}
+#endif
+
+/*** runtime cpu dispatch ***/
+struct brc_dispatch_s {
+	const char * name;
+	void (*vsrc_ranks)(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state);
+	void (*vsrc_symbols)(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state);
+	size_t (*rlt_forwards)(unsigned char * src, unsigned char * dst, size_t size);
+	size_t (*rlt_reverse)(unsigned char * src, unsigned char * dst, size_t size, size_t dst_capacity);
+	void (*vsrc_ranks_narrow[VSRC_NARROW])(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state);
+	void (*vsrc_symbols_narrow[VSRC_NARROW])(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state);
+	void (*vsrc_chains[BRC_MAX_INTERLEAVE - 1])(vsrc_chain_s ** chains, size_t steps); /* 2, 3 and 4 chains */
+	void (*vsrc_fused)(vsrc_cursor_s * cursor, unsigned char * end, unsigned char * dst, size_t dst_size, vmtf_s * state);
+	void (*mtf_ranks)(unsigned char * src, unsigned char * dst, size_t size, vmtf_s * state);
+	uint32_t (*crc32c)(uint32_t crc, const unsigned char * src, size_t size);
+};
+
+/* BRC_SIMD=std|sse2|avx2 in the environment caps the selection, for testing older targets on newer hardware */
+int brc_simd_cap() {
+	const char * cap = getenv("BRC_SIMD");
+	if(cap != NULL) {
+		if(strcmp(cap, "std") == 0) return 0;
+		if(strcmp(cap, "sse2") == 0) return 1;
+		if(strcmp(cap, "avx2") == 0) return 2;
+	}
+	return 3;
+}
+
+static brc_dispatch_s brc_detect_cpu() {
+	brc_dispatch_s d = { "std", vsrc_ranks_std, vsrc_symbols_std, rlt_forwards_std, rlt_reverse_std,
+		{ vsrc_ranks_narrow_std<16>, vsrc_ranks_narrow_std<32>, vsrc_ranks_narrow_std<64> },
+		{ vsrc_symbols_narrow_std<16>, vsrc_symbols_narrow_std<32>, vsrc_symbols_narrow_std<64> },
+		{ vsrc_chains_std<2>, vsrc_chains_std<3>, vsrc_chains_std<4> }, vsrc_fused_std, mtf_ranks_std, crc32c_std };
+#ifdef BRC_X86
+	int level = brc_simd_cap();
+	__builtin_cpu_init();
+	if(level >= 1 && __builtin_cpu_supports("sse2")) {
+		d.rlt_forwards = rlt_forwards_sse2;
+		d.rlt_reverse = rlt_reverse_sse2;
+	}
+	if(level >= 1 && __builtin_cpu_supports("ssse3")) {
+		d.vsrc_ranks_narrow[0] = vsrc_ranks_narrow_ssse3<16>;
+		d.vsrc_ranks_narrow[1] = vsrc_ranks_narrow_ssse3<32>;
+		d.vsrc_ranks_narrow[2] = vsrc_ranks_narrow_ssse3<64>;
+		d.vsrc_symbols_narrow[0] = vsrc_symbols_narrow_ssse3<16>;
+		d.vsrc_symbols_narrow[1] = vsrc_symbols_narrow_ssse3<32>;
+		d.vsrc_symbols_narrow[2] = vsrc_symbols_narrow_ssse3<64>;
+	}
+	/* every cpu with avx2 has the crc32 instruction, so BRC_SIMD=sse2 and std leave the table kernel */
+	if(level >= 2 && __builtin_cpu_supports("sse4.2"))
+		d.crc32c = crc32c_sse42;
+	if(level >= 3 && __builtin_cpu_supports("avx512bw"))
+		d.vsrc_ranks_narrow[2] = vsrc_ranks_narrow_avx512;
+	if(level >= 3 && __builtin_cpu_supports("avx512bw")) {
+		d.name = "avx512bw";
+		d.vsrc_ranks = vsrc_ranks_avx512;
+		d.vsrc_symbols = vsrc_symbols_avx512;
+		d.vsrc_chains[0] = vsrc_chains_avx512<2>;
+		d.vsrc_chains[1] = vsrc_chains_avx512<3>;
+		d.vsrc_chains[2] = vsrc_chains_avx512<4>;
+		d.vsrc_fused = vsrc_fused_avx512;
+		d.mtf_ranks = mtf_ranks_avx512;
+	} else if(level >= 2 && __builtin_cpu_supports("avx2")) {
+		d.name = "avx2";
+		d.vsrc_ranks = vsrc_ranks_avx2;
+		d.vsrc_symbols = vsrc_symbols_avx2;
+		d.vsrc_chains[0] = vsrc_chains_avx2<2>;
+		d.vsrc_chains[1] = vsrc_chains_avx2<3>;
+		d.vsrc_chains[2] = vsrc_chains_avx2<4>;
+		d.vsrc_fused = vsrc_fused_avx2;
+		d.mtf_ranks = mtf_ranks_avx2;
+	} else if(level >= 1 && __builtin_cpu_supports("sse2")) {
+		d.name = "sse2";
+		d.vsrc_ranks = vsrc_ranks_sse2;
+		d.vsrc_symbols = vsrc_symbols_sse2;
+		d.vsrc_chains[0] = vsrc_chains_sse2<2>;
+		d.vsrc_chains[1] = vsrc_chains_sse2<3>;
+		d.vsrc_chains[2] = vsrc_chains_sse2<4>;
+		d.vsrc_fused = vsrc_fused_sse2;
+		d.mtf_ranks = mtf_ranks_sse2;
+	}
+#endif
+	return d;
+}
+
+/* kernels are picked once on first use, static init is thread safe in c++11 */
+static const brc_dispatch_s & brc_dispatch() {
+	static const brc_dispatch_s d = brc_detect_cpu();
+	return d;
+}
+
+const char * brc_simd_name() {
+	return brc_dispatch().name;
+}
+
+uint32_t brc_checksum(const unsigned char * src, size_t size) {
+	return ~brc_dispatch().crc32c(~0u, src, size);
+}
+
+size_t rlt_forwards(unsigned char * src, unsigned char * dst, size_t size) {
+	return brc_dispatch().rlt_forwards(src, dst, size);
+}
+
+/* 'size' excludes the descriptor, which is passed as 'flags'; returns 0 if the runs do not fit 'dst_capacity' */
+size_t rlt_reverse(unsigned char * src, unsigned char * dst, size_t size, size_t dst_capacity, int flags) {
+	if((flags & BRC_BLOCK_RLT) == 0) {
+		if(size > dst_capacity) return 0;
+		brc_memcopy_separate(dst, src, size);
+		return size;
+	}
+	return brc_dispatch().rlt_reverse(src, dst, size, dst_capacity);
+}
+
+/* the narrow kernels take the same state as the full ones, a block's symbol count picks between them */
+void vsrc_ranks(unsigned char * src, unsigned char * dst, size_t src_size, size_t * bucket, vmtf_s * state, size_t unique_syms) {
+	size_t c = vsrc_narrow_class(unique_syms);
+	if(c == VSRC_NARROW)
+		brc_dispatch().vsrc_ranks(src, dst, src_size, bucket, state);
+	else
+		brc_dispatch().vsrc_ranks_narrow[c](src, dst, src_size, bucket, state);
+}
+
+void vsrc_symbols(unsigned char * src, unsigned char * dst, size_t dst_size, size_t * bucket, size_t * bucket_end, vmtf_s * state, size_t unique_syms) {
+	size_t c = vsrc_narrow_class(unique_syms);
+	if(c == VSRC_NARROW)
+		brc_dispatch().vsrc_symbols(src, dst, dst_size, bucket, bucket_end, state);
+	else
+		brc_dispatch().vsrc_symbols_narrow[c](src, dst, dst_size, bucket, bucket_end, state);
+}
+
+/* runs the chains in lockstep until they have all finished, the last one left on its own kernel */
+void vsrc_symbols_interleaved(vsrc_chain_s * chains, size_t num_chains) {
+	vsrc_chain_s * live[BRC_MAX_INTERLEAVE];
+	size_t n = 0;
+	for(size_t j = 0; j < num_chains; j++)
+		if(chains[j].size > 0) live[n++] = &chains[j];
+	while(n > 1) {
+		size_t steps = live[0]->size;
+		for(size_t j = 1; j < n; j++)
+			if(live[j]->size < steps) steps = live[j]->size;
+		brc_dispatch().vsrc_chains[n - 2](live, steps);
+		size_t k = 0;
+		for(size_t j = 0; j < n; j++) {
+			live[j]->dst += steps;
+			live[j]->size -= steps;
+			if(live[j]->size > 0) live[k++] = live[j];
+		}
+		n = k;
+	}
+	if(n == 1)
+		vsrc_symbols(live[0]->src, live[0]->dst, live[0]->size, live[0]->bucket, live[0]->bucket_end, &live[0]->state, live[0]->unique_syms);
+}
+
+/* ranks of one of the faster stages, BRC_STAGE_NONE copies; each byte is read before it is written, so 'src' may be 'dst' */
+void stage_forwards(int stage, unsigned char * src, unsigned char * dst, size_t size) {
+	if(stage == BRC_STAGE_MTF) {
+		vmtf_s state;
+		init_vmtf(&state);
+		brc_dispatch().mtf_ranks(src, dst, size, &state);
+	} else if(stage == BRC_STAGE_RUNS) {
+		runs_forwards(src, dst, size);
+	} else if(src != dst) {
+		memcpy(dst, src, size);
+	}
+}
+
+/* 'src' may be 'dst' as well */
+void stage_reverse(int stage, unsigned char * src, unsigned char * dst, size_t size) {
+	if(stage == BRC_STAGE_MTF) mtf_symbols(src, dst, size);
+	else if(stage == BRC_STAGE_RUNS) runs_reverse(src, dst, size);
+	else if(src != dst) memcpy(dst, src, size);
+}
+
+/* 'counts' is the histogram of 'src' when the caller has it already, else NULL */
+size_t vsrc_forwards(unsigned char * src, unsigned char * dst, size_t src_size, uint64_t * counts, brc_shared_s * shared, int * flags) {
+	unsigned char * read_head  = src;
+	unsigned char * write_head = dst;
+
+	vmtf_s state;
+	init_vmtf(&state);
+
+	size_t bucket[256] = {0};
+	uint64_t freqs[256] = {0};
+	unsigned char sort_map[256], s;
+
+	size_t unique_syms = 0;
+	if(counts) {
+		/* initial ranks still follow first appearance, which is known once every present symbol has been seen */
+		bool seen[256] = {false};
+		size_t present = 0;
+		for(size_t i = 0; i < 256; i++)
+			freqs[i] = counts[i], present += counts[i] > 0;
+		for(size_t i = 0; unique_syms < present; i++) {
+			s = read_head[i];
+			if(!seen[s]) 
+				seen[s] = true, state.map[s] = unique_syms++;
+		}
+	} else {
+		for (size_t i = 0; i < src_size; i++) {
+			s = read_head[i];
+			if (freqs[s] == 0)
+				state.map[s] = unique_syms++;
+			freqs[s]++;
+		}
+	}
+
+	size_t footer_size = vsrc_write_footer(dst + src_size, freqs, flags);
+	generate_bucket_map(freqs, shared, sort_map);
+
+	for(size_t i = 0, bucket_pos = 0; i < unique_syms; i++) {
+		s = sort_map[i];
+		bucket[s] = bucket_pos;
+		bucket_pos += freqs[s];
+	}
+
+	vsrc_ranks(read_head, write_head, src_size, bucket, &state, unique_syms);
+	return src_size + footer_size;
+}
+
+/*** segmented sorted rank transform ***/
+/*
+	A block can be split into segments which are ranked and unranked on separate threads. Between the
+	ranks and the frequency table sits a checkpoint area: the segment count, then for every segment after
+	the first the number of times each present symbol occurs before it, followed by the decoder's rank
+	list at that point (symbols in order of next occurrence). Segment k starts at k * (size / segments).
+	Counts are uint32, or uint64 in blocks of more than 4GB.
+*/
+size_t vsrc_max_segments(size_t size) {
+	size_t k = size / BRC_MIN_SEGMENT_SIZE;
+	if(k > BRC_MAX_SEGMENTS) k = BRC_MAX_SEGMENTS;
+	return k > 1 ? k : 1;
+}
+
+inline size_t vsrc_count_width(size_t size) {
+	return size > UINT32_MAX ? sizeof(uint64_t) : sizeof(uint32_t);
+}
+
+size_t vsrc_checkpoint_bound(size_t size) {
+	size_t k = vsrc_max_segments(size);
+	return k > 1 ? sizeof(uint32_t) + (k - 1) * (vsrc_count_width(size) * 256 + 1 + 256) : 0;
+}
+
+/* per segment tables of the segmented encoder, owned by the context once a segmented block is seen */
+struct brc_scratch_s {
+	uint64_t counts[(BRC_MAX_SEGMENTS + 1) * 256];
+	size_t firsts[BRC_MAX_SEGMENTS * 256];
+	unsigned char live[BRC_MAX_SEGMENTS * 256];
+};
+
+size_t vsrc_forwards_segmented(unsigned char * src, unsigned char * dst, size_t src_size, size_t segments, brc_scratch_s * scratch, brc_shared_s * shared, int * flags) {
+	size_t seg_size = src_size / segments, width = vsrc_count_width(src_size);
+	uint64_t * counts = scratch->counts;
+	size_t * firsts = scratch->firsts;
+	unsigned char * live = scratch->live;
+	memset(counts, 0, (segments + 1) * 256 * sizeof(uint64_t));
+
+	/* per segment histograms and first occurrences */
+	#pragma omp parallel for num_threads(segments)
+	for(int k = 0; k < (int)segments; k++) {
+		size_t begin = k * seg_size, end = (k + 1 == (int)segments) ? src_size : begin + seg_size;
+		uint64_t * hist = &counts[(k + 1) * 256];
+		size_t * first = &firsts[k * 256];
+		for(size_t i = 0; i < 256; i++)
+			first[i] = SIZE_MAX;
+		for(size_t i = begin; i < end; i++) {
+			if(hist[src[i]]++ == 0)
+				first[src[i]] = i;
+		}
+	}
+
+	/* turn them into the number of occurrences before each segment */
+	size_t first[256];
+	for(size_t i = 0; i < 256; i++)
+		first[i] = SIZE_MAX;
+	for(size_t k = 0; k < segments; k++) {
+		for(size_t i = 0; i < 256; i++) {
+			counts[(k + 1) * 256 + i] += counts[k * 256 + i];
+			if(first[i] == SIZE_MAX) first[i] = firsts[k * 256 + i];
+		}
+	}
+	uint64_t * freqs = &counts[segments * 256];
+
+	/* initial ranks follow the order of first appearance, same as vsrc_forwards */
+	unsigned char initial[256] = {0}, by_first[256];
+	size_t unique_syms = 0;
+	for(size_t i = 0; i < 256; i++) {
+		if(freqs[i] == 0) continue;
+		size_t j = unique_syms++;
+		while(j > 0 && first[by_first[j - 1]] > first[i]) {
+			by_first[j] = by_first[j - 1];
+			j--;
+		}
+		by_first[j] = i;
+	}
+	for(size_t i = 0; i < unique_syms; i++)
+		initial[by_first[i]] = i;
+
+	unsigned char sort_map[256];
+	size_t bucket_start[256] = {0};
+	generate_bucket_map(freqs, shared, sort_map);
+	for(size_t i = 0, bucket_pos = 0; i < unique_syms; i++) {
+		bucket_start[sort_map[i]] = bucket_pos;
+		bucket_pos += freqs[sort_map[i]];
+	}
+
+	size_t live_len[BRC_MAX_SEGMENTS] = {0};
+
+	#pragma omp parallel for num_threads(segments)
+	for(int k = 0; k < (int)segments; k++) {
+		size_t begin = k * seg_size, end = (k + 1 == (int)segments) ? src_size : begin + seg_size;
+		uint64_t * before = &counts[k * 256];
+		vmtf_s state;
+		init_vmtf(&state);
+		size_t bucket[256], seen = 0, pending = 0;
+		bool found[256] = {false};
+		for(size_t i = 0; i < 256; i++) {
+			bucket[i] = bucket_start[i] + before[i];
+			if(freqs[i] == 0) continue;
+			state.map[i] = initial[i];
+			if(before[i] > 0) seen++;
+			if(before[i] < freqs[i]) pending++;
+		}
+
+		/* encoder state: symbols seen so far in order of recency, then the rest in their initial order */
+		for(size_t i = begin, r = 0; r < seen; i--) {
+			unsigned char c = src[i - 1];
+			if(!found[c]) found[c] = true, state.map[c] = r++;
+		}
+
+		/* decoder state: symbols still to come in order of next occurrence */
+		if(k > 0) {
+			memset(found, 0, sizeof(found));
+			for(size_t i = begin, r = 0; r < pending; i++) {
+				unsigned char c = src[i];
+				if(!found[c]) found[c] = true, live[k * 256 + r++] = c;
+			}
+			live_len[k] = pending;
+		}
+
+		vsrc_ranks(src + begin, dst, end - begin, bucket, &state, unique_syms);
+	}
+
+	unsigned char * write_head = dst + src_size;
+	uint32_t num_segments = segments;
+	memcpy(write_head, &num_segments, sizeof(num_segments));
+	write_head += sizeof(num_segments);
+	for(size_t k = 1; k < segments; k++) {
+		for(size_t i = 0; i < 256; i++) {
+			if(freqs[i] == 0) continue;
+			if(width == sizeof(uint32_t)) {
+				uint32_t count = counts[k * 256 + i];
+				memcpy(write_head, &count, sizeof(count));
+			} else {
+				memcpy(write_head, &counts[k * 256 + i], sizeof(uint64_t));
+			}
+			write_head += width;
+		}
+		*write_head++ = live_len[k] - 1;
+		memcpy(write_head, &live[k * 256], live_len[k]);
+		write_head += live_len[k];
+	}
+
+	write_head += vsrc_write_footer(write_head, freqs, flags);
+
+	return write_head - dst;
+}
+
+/* a checkpoint's count of one symbol, 'width' bytes wide */
+static uint64_t vsrc_read_count(unsigned char * cp, size_t width) {
+	if(width == sizeof(uint32_t)) {
+		uint32_t count;
+		memcpy(&count, cp, sizeof(count));
+		return count;
+	}
+	uint64_t count;
+	memcpy(&count, cp, sizeof(count));
+	return count;
+}
+
+int vsrc_reverse_segmented(unsigned char * src, unsigned char * dst, size_t dst_size, size_t area_size, uint64_t * freqs, unsigned char * sort_map, size_t unique_syms, size_t interleave) {
+	unsigned char * area = src + dst_size, * area_end = area + area_size;
+	uint32_t num_segments;
+	if(area_size < sizeof(num_segments))
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+	memcpy(&num_segments, area, sizeof(num_segments));
+	if(num_segments < 2 || num_segments > BRC_MAX_SEGMENTS || dst_size / num_segments == 0)
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+
+	size_t segments = num_segments, seg_size = dst_size / segments, width = vsrc_count_width(dst_size);
+
+	unsigned char * checkpoint[BRC_MAX_SEGMENTS];
+	unsigned char * read_head = area + sizeof(num_segments);
+	for(size_t k = 1; k < segments; k++) {
+		checkpoint[k] = read_head;
+		read_head += unique_syms * width;
+		if(read_head >= area_end) 
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		read_head += 1 + ((size_t)*read_head + 1);
+	}
+	if(read_head != area_end) 
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+
+	size_t bucket_start[256] = {0};
+	for(size_t i = 0, bucket_pos = 0; i < unique_syms; i++) {
+		bucket_start[sort_map[i]] = bucket_pos;
+		bucket_pos += freqs[sort_map[i]];
+	}
+
+	/* the unranking kernels read a bucket before checking its end, so no count may point past its bucket */
+	for(size_t k = 1; k < segments; k++) {
+		unsigned char * cp = checkpoint[k];
+		for(size_t i = 0; i < 256; i++) {
+			if(freqs[i] == 0) continue;
+			if(vsrc_read_count(cp, width) > freqs[i])
+				return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+			cp += width;
+		}
+	}
+
+	/* each thread takes 'interleave' consecutive segments and unranks them together */
+	if(interleave < 1) interleave = 1;
+	if(interleave > BRC_MAX_INTERLEAVE) interleave = BRC_MAX_INTERLEAVE;
+	int groups = (segments + interleave - 1) / interleave;
+
+	#pragma omp parallel for num_threads(groups)
+	for(int g = 0; g < groups; g++) {
+		vsrc_chain_s chains[BRC_MAX_INTERLEAVE];
+		size_t n = 0;
+		for(size_t k = g * interleave; k < segments && n < interleave; k++, n++) {
+			vsrc_chain_s * chain = &chains[n];
+			size_t begin = k * seg_size, end = (k + 1 == segments) ? dst_size : begin + seg_size;
+			init_vmtf(&chain->state);
+			chain->src = src;
+			chain->dst = dst + begin;
+			chain->size = end - begin;
+			chain->unique_syms = unique_syms;
+			memset(chain->bucket, 0, sizeof(chain->bucket));
+			memset(chain->bucket_end, 0, sizeof(chain->bucket_end));
+			if(k == 0) {
+				for(size_t i = 0; i < unique_syms; i++) {
+					unsigned char s = sort_map[i];
+					chain->state.map[src[bucket_start[s]]] = s;
+					chain->bucket[s] = bucket_start[s] + 1;
+					chain->bucket_end[s] = bucket_start[s] + freqs[s];
+				}
+			} else {
+				unsigned char * cp = checkpoint[k];
+				for(size_t i = 0; i < 256; i++) {
+					if(freqs[i] == 0) continue;
+					uint64_t before = vsrc_read_count(cp, width);
+					cp += width;
+					chain->bucket[i] = bucket_start[i] + before + 1;
+					chain->bucket_end[i] = bucket_start[i] + freqs[i];
+				}
+				size_t live = (size_t)*cp++ + 1;
+				for(size_t i = 0; i < live; i++)
+					chain->state.map[i] = cp[i];
+			}
+		}
+		vsrc_symbols_interleaved(chains, n);
+	}
+
+	return BRC_EXIT_SUCCESS;
+}
+
+/*
+	Reads the tables at the end of 'src_size' bytes of ranks and sets 'chain' up to unrank them into 'dst'.
+	A segmented block is unranked right away on threads of its own and leaves nothing for the chain to do.
+	Returns 0 on success, else -1.
+*/
+int vsrc_reverse_begin(unsigned char * src, unsigned char * dst, size_t src_size, int flags, brc_shared_s * shared, size_t interleave, vsrc_chain_s * chain, size_t * dst_size) {
+	unsigned char * read_head  = src;
+	chain->size = 0;
+	if((flags & BRC_BLOCK_SHARED) && shared == NULL)
+		return printf(" Block needs the shared table it was encoded with! \n"), BRC_EXIT_FAILURE;
+
+	uint64_t freqs[256] = {0};
+	unsigned char sort_map[256], s;
+
+	size_t footer_size = vsrc_read_footer(src, src_size, flags, freqs);
+	if(footer_size == 0)
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+
+	size_t total = 0;
+	for(size_t i = 0; i < 256; i++)
+		total += freqs[i];
+
+	if(total > src_size - footer_size) 
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+
+	size_t unique_syms = generate_bucket_map(freqs, (flags & BRC_BLOCK_SHARED) ? shared : NULL, sort_map);
+
+	/* anything between the ranks and the frequency table are segment checkpoints */
+	*dst_size = total;
+	if(total < src_size - footer_size)
+		return vsrc_reverse_segmented(src, dst, total, src_size - footer_size - total, freqs, sort_map, unique_syms, interleave);
+
+	init_vmtf(&chain->state);
+	memset(chain->bucket, 0, sizeof(chain->bucket));
+	memset(chain->bucket_end, 0, sizeof(chain->bucket_end));
+	for(size_t i = 0, bucket_pos = 0; i < unique_syms; i++) {
+		s = sort_map[i];
+		chain->state.map[read_head[bucket_pos]] = s;
+		chain->bucket[s] = bucket_pos + 1;
+		bucket_pos += freqs[s];
+		chain->bucket_end[s] = bucket_pos;
+	}
+	chain->src = read_head;
+	chain->dst = dst;
+	chain->size = total;
+	chain->unique_syms = unique_syms;
+	return BRC_EXIT_SUCCESS;
+}
+
+/* unranks 'src_size' bytes of ranks, checkpoints and frequencies into 'dst'; returns 0 on success, else -1 */
+int vsrc_reverse(unsigned char * src, unsigned char * dst, size_t src_size, int flags, brc_shared_s * shared, size_t interleave, size_t * dst_size) {
+	vsrc_chain_s chain;
+	if(vsrc_reverse_begin(src, dst, src_size, flags, shared, interleave, &chain, dst_size) == BRC_EXIT_FAILURE)
+		return BRC_EXIT_FAILURE;
+	vsrc_symbols_interleaved(&chain, 1);
+	return BRC_EXIT_SUCCESS;
+}
+
+/* number of bytes vsrc_reverse will write for a ranked block of 'src_size' bytes */
+size_t vsrc_decoded_size(unsigned char * src, size_t src_size, int flags) {
+	uint64_t freqs[256];
+	if(vsrc_read_footer(src, src_size, flags, freqs) == 0) return 0;
+	size_t total = 0;
+	for(size_t i = 0; i < 256; i++)
+		total += freqs[i];
+	return total;
+}
+
+/*
+	The fused decoder walks the stream once to find its decoded size, keeping where every 64th token of
+	the last VSRC_FUSED_MARKS starts, expands the frequency table at its end from the last of those before
+	it, and walks the stream once more to set the cursors at the start of every bucket.
+*/
+#define VSRC_FUSED_MARKS (128)
+
+struct rlt_mark_s {
+	size_t offset, pos;
+};
+
+/* decoded size of a run length coded stream, 0 if it is malformed */
+static size_t rlt_scan(unsigned char * src, size_t size, rlt_mark_s * marks) {
+	unsigned char * p = src, * end = src + size, rank;
+	size_t pos = 0, run;
+	for(size_t tokens = 0; p < end; tokens++) {
+		if((tokens & 63) == 0) {
+			rlt_mark_s * mark = &marks[(tokens >> 6) & (VSRC_FUSED_MARKS - 1)];
+			mark->offset = p - src, mark->pos = pos;
+		}
+		p = rlt_next_token(p, end, &rank, &run);
+		if(p == NULL) return 0;
+		pos += run ? run : 1;
+	}
+	return pos;
+}
+
+/* expands the decoded bytes from 'from' to 'to' of the stream, starting at the latest mark before them */
+static int rlt_expand_tail(unsigned char * src, size_t size, rlt_mark_s * marks, size_t from, size_t to, unsigned char * dst) {
+	rlt_mark_s start = {0, 0};
+	for(size_t k = 0; k < VSRC_FUSED_MARKS; k++)
+		if(marks[k].pos <= from && marks[k].pos >= start.pos) start = marks[k];
+	unsigned char * p = src + start.offset, * end = src + size, rank;
+	size_t pos = start.pos, run;
+	while(pos < to) {
+		p = rlt_next_token(p, end, &rank, &run);
+		if(p == NULL) return BRC_EXIT_FAILURE;
+		size_t len = run ? run : 1;
+		for(size_t i = pos > from ? pos : from; i < pos + len && i < to; i++)
+			dst[i - from] = rank;
+		pos += len;
+	}
+	return BRC_EXIT_SUCCESS;
+}
+
+/*
+	Unranks the run length coded ranks in 'src' into 'dst' without expanding them. Only blocks of one
+	segment with at least VSRC_FUSED_RATIO ranks per byte of 'src' are taken, anything else returns 1
+	before writing 'dst' and is left to vsrc_reverse. Returns 0 on success, else -1.
+*/
+int vsrc_reverse_fused(unsigned char * src, size_t src_size, unsigned char * dst, size_t dst_capacity, int flags, brc_shared_s * shared, size_t * dst_size) {
+	if((flags & BRC_BLOCK_SHARED) && shared == NULL)
+		return printf(" Block needs the shared table it was encoded with! \n"), BRC_EXIT_FAILURE;
+
+	rlt_mark_s marks[VSRC_FUSED_MARKS];
+	memset(marks, 0, sizeof(marks));
+	size_t ranks_size = rlt_scan(src, src_size, marks);
+	if(ranks_size == 0)
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+	if(ranks_size / VSRC_FUSED_RATIO < src_size) return 1;
+
+	unsigned char tail[BRC_COMPACT_FOOTER_MAX > BRC_VSRC_FOOTER_SIZE ? BRC_COMPACT_FOOTER_MAX : BRC_VSRC_FOOTER_SIZE];
+	size_t tail_size = (flags & BRC_BLOCK_COMPACT) ? BRC_COMPACT_FOOTER_MAX : BRC_VSRC_FOOTER_SIZE;
+	if(tail_size > ranks_size) tail_size = ranks_size;
+	if(rlt_expand_tail(src, src_size, marks, ranks_size - tail_size, ranks_size, tail) == BRC_EXIT_FAILURE)
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+
+	uint64_t freqs[256];
+	size_t footer_size = vsrc_parse_footer(tail + tail_size, tail_size, ranks_size, flags, freqs);
+	if(footer_size == 0)
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+	size_t total = 0;
+	for(size_t i = 0; i < 256; i++)
+		total += freqs[i];
+	if(total > ranks_size - footer_size || total > dst_capacity)
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+	if(total < ranks_size - footer_size) return 1;
+
+	unsigned char sort_map[256];
+	size_t unique_syms = generate_bucket_map(freqs, (flags & BRC_BLOCK_SHARED) ? shared : NULL, sort_map);
+
+	/* buckets follow each other in the stream, so one walk finds where each of them starts */
+	vsrc_cursor_s cursor[256];
+	memset(cursor, 0, sizeof(cursor));
+	unsigned char * p = src, * end = src + src_size, rank;
+	size_t pos = 0, run = 0, len = 0, bucket_pos = 0;
+	unsigned char * token = p;
+	for(size_t i = 0; i < unique_syms; i++) {
+		unsigned char s = sort_map[i];
+		while(pos + len <= bucket_pos) {
+			pos += len;
+			token = p;
+			p = rlt_next_token(p, end, &rank, &run);
+			if(p == NULL) return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+			len = run ? run : 1;
+		}
+		cursor[s].read_head = run ? p : token;
+		cursor[s].left = freqs[s];
+		cursor[s].zeros = run ? pos + len - bucket_pos : 0;
+		if(cursor[s].zeros > freqs[s]) cursor[s].zeros = freqs[s];
+		bucket_pos += freqs[s];
+	}
+
+	/* the first rank of a bucket places its symbol in the initial list */
+	vmtf_s state;
+	init_vmtf(&state);
+	for(size_t i = 0; i < unique_syms; i++) {
+		unsigned char s = sort_map[i];
+		state.map[vsrc_cursor_next(&cursor[s], end)] = s;
+	}
+	brc_dispatch().vsrc_fused(cursor, end, dst, total, &state);
+	*dst_size = total;
+	return BRC_EXIT_SUCCESS;
+}
+
+/*** block pre-scan ***/
+/*
+	brc_encode looks at every block before transforming it. A block of one symbol is stored as a run, and
+	one whose order-0 entropy is within 1% of 8 bits while it repeats a byte no more than twice as often as
+	random bytes do is stored as it is: its ranks would have next to no zeros for the run length coder and
+	spread over all 256 values. Either decodes at memset or memcpy speed. The histogram is kept for the
+	transform, which then only has to find the order in which the symbols first appear.
+*/
+/* four tables so consecutive equal bytes do not wait on each other's increments; returns the number of symbols present */
+static size_t brc_histogram(unsigned char * src, size_t size, uint64_t * freqs) {
+	uint64_t tables[4][256];
+	memset(tables, 0, sizeof(tables));
+	size_t i = 0;
+	for(; i + 4 <= size; i += 4) {
+		tables[0][src[i]]++;
+		tables[1][src[i + 1]]++;
+		tables[2][src[i + 2]]++;
+		tables[3][src[i + 3]]++;
+	}
+	for(; i < size; i++)
+		tables[0][src[i]]++;
+	size_t unique_syms = 0;
+	for(size_t c = 0; c < 256; c++) {
+		freqs[c] = tables[0][c] + tables[1][c] + tables[2][c] + tables[3][c];
+		unique_syms += freqs[c] > 0;
+	}
+	return unique_syms;
+}
+
+/* bytes equal to the one before them */
+static size_t brc_repeats(unsigned char * src, size_t size) {
+	size_t repeats = 0;
+	for(size_t i = 1; i < size; i++)
+		repeats += src[i] == src[i - 1];
+	return repeats;
+}
+
+static bool brc_incompressible(uint64_t * freqs, size_t size, size_t repeats) {
+	if(size == 0 || repeats > size / 128) return false;
+	double bits = 0;
+	for(size_t i = 0; i < 256; i++)
+		if(freqs[i] > 0) bits += freqs[i] * log2((double)size / freqs[i]);
+	return bits >= 7.92 * size;
+}
+
+/*
+	Below BRC_MAX_LEVEL every rank stage codes a sample from the middle of the block and the fastest one
+	whose estimate is within the level's margin of the smallest is taken. The sorted rank transform puts
+	its output in 'swap', the others may too; the block has not been ranked yet, so it is free.
+*/
+static const double brc_level_margin[BRC_MAX_LEVEL - 1] = { 0.25, 0.08, 0.02 };
+
+/* tries the stages from 'first' on, ranking the sample into 'scratch'; level is below BRC_MAX_LEVEL */
+static int brc_pick_stage(unsigned char * sample, size_t n, unsigned char * scratch, int first, int level, int entropy, brc_shared_s * shared) {
+	if(level < 1) level = 1;
+	double cost[BRC_STAGES], best = 0;
+	for(int stage = first; stage < BRC_STAGES; stage++) {
+		unsigned char * ranks = scratch;
+		if(stage == BRC_STAGE_RANK) {
+			int flags = 0;
+			vsrc_forwards(sample, ranks, n, NULL, shared, &flags);
+		} else if(stage == BRC_STAGE_NONE) {
+			ranks = sample;
+		} else {
+			stage_forwards(stage, sample, ranks, n);
+		}
+		cost[stage] = rlt_estimate(ranks, n, entropy);
+		if(stage == first || cost[stage] < best) best = cost[stage];
+	}
+	for(int stage = BRC_STAGES - 1; stage > first; stage--)
+		if(cost[stage] <= best * (1 + brc_level_margin[level - 1])) return stage;
+	return first;
+}
+
+static int brc_choose_stage(brc_cxt_s * brc_cxt, unsigned char * src, size_t size) {
+	if(brc_cxt->level >= BRC_MAX_LEVEL || size == 0) return BRC_STAGE_RANK;
+	size_t n = size < BRC_SAMPLE_SIZE ? size : BRC_SAMPLE_SIZE;
+	return brc_pick_stage(src + (size - n) / 2, n, brc_cxt->swap, BRC_STAGE_RANK, brc_cxt->level, brc_cxt->entropy, brc_cxt->shared);
+}
+
+/* writes 'src' as a BRC_BLOCK_RUN or BRC_BLOCK_STORED block; returns the packed size */
+static size_t brc_pack_plain(unsigned char * src, size_t size, int kind, unsigned char * dst) {
+	if(kind == BRC_BLOCK_RUN) {
+		unsigned char * write_head = brc_put_varint(dst, size);
+		*write_head++ = src[0];
+		*write_head++ = BRC_BLOCK_RUN;
+		return write_head - dst;
+	}
+	memcpy(dst, src, size);
+	dst[size] = BRC_BLOCK_STORED;
+	return size + BRC_RLT_FOOTER_SIZE;
+}
+
+/*** size estimate ***/
+/*
+	The sorted rank transform gives byte i rank 0 exactly when it repeats byte i - 1, and lists each symbol's
+	ranks in order, so a run of L equal bytes leaves L - 1 zeros together in its bucket after one nonzero
+	rank. The run length coded size therefore follows from the block's runs alone: one byte per run plus
+	the bits of L below its top bit. Only the values of the nonzero ranks need the transform, for the
+	entropy estimate, and they are taken from a few windows of the block ranked on the stack.
+*/
+#define BRC_ESTIMATE_WINDOW (1 << 14) /* largest window */
+#define BRC_ESTIMATE_MIN_WINDOW (256)
+#define BRC_ESTIMATE_WINDOWS (4)
+#define BRC_ESTIMATE_FRACTION (16) /* at most this fraction of the block is ranked, unless that is under one small window */
+#define BRC_RANS_HEADER_SIZE (sizeof(uint64_t) + 32 + 8 * sizeof(uint32_t)) /* rans_encode's count, symbol bitmap and final states */
+
+/* bit k is set when src[k] equals src[k - 1], for the 8 bytes at 'src' */
+static inline uint64_t brc_repeat_bits(const unsigned char * src) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	uint64_t bits = 0;
+	for(size_t k = 0; k < 8; k++)
+		bits |= (uint64_t)(src[k] == src[k - 1]) << k;
+	return bits;
+#else
+	/* a byte of the xor is zero exactly when its top bit survives, without the borrows of the usual zero byte test */
+	uint64_t a, b;
+	memcpy(&a, src, sizeof(a));
+	memcpy(&b, src - 1, sizeof(b));
+	uint64_t x = a ^ b, low = 0x7f7f7f7f7f7f7f7full;
+	uint64_t zero = ~(((x & low) + low) | x | low);
+	return ((zero >> 7) * 0x0102040810204080ull) >> 56;
+#endif
+}
+
+/* adds the header bytes of the zero runs among 'bits', the repeats of 'count' bytes, to 'headers'; 'open' carries a run over to the next call */
+static inline void brc_count_runs(uint64_t bits, size_t count, size_t * open, uint64_t * headers) {
+	size_t pos = 0;
+	while(pos < count) {
+		uint64_t rest = bits >> pos;
+		if(rest & 1) {
+			size_t ones = ~rest == 0 ? 64 - pos : brc_ctz(~rest);
+			if(ones > count - pos) ones = count - pos;
+			*open += ones, pos += ones;
+			continue;
+		}
+		/* L bytes leave L - 1 zeros, coded as the bits of L below its top bit */
+		if(*open) {
+			size_t L = *open + 1, ones = brc_popcount(L) - 1;
+			headers[1] += ones, headers[0] += brc_bsr(L) - ones;
+			*open = 0;
+		}
+		if(rest == 0) break;
+		pos += brc_ctz(rest);
+	}
+}
+
+/* order-0 size in bytes of 'n' symbols with counts 'freqs' */
+static double brc_order0_bytes(const double * freqs, double n) {
+	double bits = 0;
+	for(size_t c = 0; c < 256; c++)
+		if(freqs[c] > 0) bits += freqs[c] * log2(n / freqs[c]);
+	return bits / 8;
+}
+
+size_t brc_estimate(unsigned char * src, size_t size, int entropy) {
+	uint64_t freqs[256];
+	size_t unique_syms = brc_histogram(src, size, freqs);
+	if(unique_syms == 1) return brc_varint_size(size) + 2;
+
+	/* run headers are counted exactly, 64 bytes at a time; every byte that is not a repeat has a nonzero rank */
+	uint64_t headers[2] = {0, 0};
+	size_t repeats = 0, open = 0, i = 1;
+	for(; i + 64 <= size; i += 64) {
+		uint64_t bits = 0;
+		for(size_t k = 0; k < 64; k += 8)
+			bits |= brc_repeat_bits(src + i + k) << k;
+		repeats += brc_popcount(bits);
+		brc_count_runs(bits, 64, &open, headers);
+	}
+	for(; i < size; i++) {
+		uint64_t bit = src[i] == src[i - 1];
+		repeats += bit;
+		brc_count_runs(bit, 1, &open, headers);
+	}
+	brc_count_runs(0, 1, &open, headers);
+	size_t runs = size - repeats;
+	if(size == 0 || brc_incompressible(freqs, size, repeats)) return size + BRC_RLT_FOOTER_SIZE;
+
+	/* escapes are rare unless nearly every byte value is present, so only the windows count them */
+	unsigned char ranks[BRC_ESTIMATE_WINDOW + BRC_VSRC_FOOTER_SIZE + BRC_PAD_SIZE];
+	double literals[256] = {0}, plain[256] = {0};
+	size_t window = size / (BRC_ESTIMATE_WINDOWS * BRC_ESTIMATE_FRACTION);
+	if(window < BRC_ESTIMATE_MIN_WINDOW) window = BRC_ESTIMATE_MIN_WINDOW;
+	if(window > BRC_ESTIMATE_WINDOW) window = BRC_ESTIMATE_WINDOW;
+	size_t windows = (size + window - 1) / window, sampled_literals = 0, escapes = 0;
+	if(windows > BRC_ESTIMATE_WINDOWS) windows = BRC_ESTIMATE_WINDOWS;
+	size_t stride = size / windows, sampled = 0;
+	for(size_t w = 0; w < windows && (entropy || unique_syms >= 0xfe); w++) {
+		size_t begin = w * stride, n = w + 1 < windows ? stride : size - begin;
+		if(n > window) n = window;
+		int flags = 0;
+		vsrc_forwards(src + begin, ranks, n, NULL, NULL, &flags);
+		for(size_t i = 0; i < n; i++) {
+			unsigned char r = ranks[i];
+			plain[r]++;
+			if(r == 0) continue;
+			if(r >= 0xfe) literals[0xff]++, literals[r == 0xff]++, escapes++;
+			else literals[r + 1]++;
+			sampled_literals++;
+		}
+		sampled += n;
+	}
+
+	/* the frequency table is run length coded with the ranks, its bitmap mostly shrinks */
+	int flags = 0;
+	size_t table_size = vsrc_write_footer(ranks, freqs, &flags);
+	double table = rlt_estimate(ranks, table_size, 0);
+	if(sampled_literals == 0 && runs > 0) {
+		/* the windows fell in runs only, so spread the literals evenly over the ranks they can take */
+		for(size_t r = 1; r < unique_syms && r < 0xfe; r++)
+			literals[r + 1]++, sampled_literals++;
+	}
+	double scale = sampled_literals ? (double)runs / sampled_literals : 0;
+	double coded = runs + escapes * scale + headers[0] + headers[1];
+	bool fallback = coded >= size;
+	double estimate = (fallback ? size : coded) + table;
+	if(entropy && sampled > 0) {
+		double counts[256], n = 0;
+		for(size_t c = 0; c < 256; c++) {
+			counts[c] = fallback ? plain[c] * size / sampled : literals[c] * scale + (c < 2 ? headers[c] : 0);
+			n += counts[c];
+		}
+		double rans = brc_order0_bytes(counts, n) + table + BRC_RANS_HEADER_SIZE + 2 * (unique_syms + 2);
+		if(rans < estimate) estimate = rans;
+	}
+	return (size_t)estimate + BRC_RLT_FOOTER_SIZE;
+}
+
+/*
+	brc_split cuts where the byte histogram shifts: for every chunk it measures how many more bits per byte
+	the chunk costs under the histogram of everything before it than under its own. BWT output shifts a
+	little all the time, as contexts change, so the few largest shifts are only candidates and brc_estimate
+	decides whether coding the two sides apart comes out smaller than coding them together.
+*/
+#define BRC_SPLIT_CHUNKS (32)
+#define BRC_SPLIT_CANDIDATES (2)
+#define BRC_SPLIT_SHIFT (0.5) /* bits per byte a chunk must lose under the histogram before it */
+#define BRC_SPLIT_GAIN (0.01) /* smallest saving worth a cut */
+
+/* bits per byte 'chunk' loses when coded with the order-0 model of 'before' rather than its own */
+static double brc_shift(uint64_t * before, size_t before_size, uint64_t * chunk, size_t chunk_size) {
+	double bits = 0;
+	for(size_t c = 0; c < 256; c++) {
+		if(chunk[c] == 0) continue;
+		double own = (double)chunk[c] / chunk_size;
+		double other = (before[c] + 0.5) / (before_size + 128.0);
+		bits += chunk[c] * log2(own / other);
+	}
+	return bits / chunk_size;
+}
+
+size_t brc_split(unsigned char * src, size_t size, size_t min_size, int entropy) {
+	size_t chunk = size / BRC_SPLIT_CHUNKS;
+	if(chunk == 0 || min_size >= size) return size;
+
+	uint64_t before[256], counts[256];
+	brc_histogram(src, chunk, before);
+	size_t cuts[BRC_SPLIT_CANDIDATES];
+	double shifts[BRC_SPLIT_CANDIDATES];
+	size_t num_cuts = 0;
+	for(size_t k = 1; k < BRC_SPLIT_CHUNKS; k++) {
+		size_t at = k * chunk;
+		brc_histogram(src + at, chunk, counts);
+		double shift = brc_shift(before, at, counts, chunk);
+		for(size_t c = 0; c < 256; c++)
+			before[c] += counts[c];
+		if(at < min_size || size - at < min_size || shift < BRC_SPLIT_SHIFT) continue;
+		/* kept sorted by shift, largest first */
+		size_t i = num_cuts < BRC_SPLIT_CANDIDATES ? num_cuts++ : BRC_SPLIT_CANDIDATES;
+		for(; i > 0 && shifts[i - 1] < shift; i--) {
+			if(i < BRC_SPLIT_CANDIDATES) cuts[i] = cuts[i - 1], shifts[i] = shifts[i - 1];
+		}
+		if(i < BRC_SPLIT_CANDIDATES) cuts[i] = at, shifts[i] = shift;
+	}
+	if(num_cuts == 0) return size;
+
+	double whole = (double)brc_estimate(src, size, entropy), best = whole * (1 - BRC_SPLIT_GAIN);
+	size_t cut = size;
+	for(size_t i = 0; i < num_cuts; i++) {
+		double apart = (double)brc_estimate(src, cuts[i], entropy) + brc_estimate(src + cuts[i], size - cuts[i], entropy);
+		if(apart < best) best = apart, cut = cuts[i];
+	}
+	return cut;
+}
+
+/*** BRC TRANSFORM ***/
+size_t brc_safe_memory_bound(size_t x) {
+	return x + vsrc_checkpoint_bound(x) + BRC_VSRC_FOOTER_SIZE + BRC_BWT_FOOTER_SIZE + BRC_STAGE_FOOTER_SIZE + BRC_RLT_FOOTER_SIZE + BRC_PAD_SIZE;
+}
+
+/* suffix array of the BWT, or the links of its inverse, allocated on the first BWT block */
+static size_t brc_sa_bytes(size_t capacity) {
+	return sizeof(int32_t) * (capacity + 1);
+}
+
+static int brc_alloc_sa(brc_cxt_s * brc_cxt) {
+	if(brc_cxt->sa == NULL)
+		brc_cxt->sa = (int32_t*)brc_cxt->allocator->alloc(brc_cxt->allocator, brc_sa_bytes(brc_cxt->capacity));
+	return brc_cxt->sa ? BRC_EXIT_SUCCESS : BRC_EXIT_FAILURE;
+}
+
+/* releases the buffers of 'brc_cxt' that are sized for its capacity */
+static void brc_release_buffers(brc_cxt_s * brc_cxt) {
+	brc_allocator_s * allocator = brc_cxt->allocator;
+	if(brc_cxt->block) allocator->free(allocator, brc_cxt->block, brc_cxt->eob);
+	if(brc_cxt->swap) allocator->free(allocator, brc_cxt->swap, brc_cxt->eob);
+	if(brc_cxt->sa) allocator->free(allocator, brc_cxt->sa, brc_sa_bytes(brc_cxt->capacity));
+	brc_cxt->block = brc_cxt->swap = NULL;
+	brc_cxt->sa = NULL;
+}
+
+int brc_init_cxt(brc_cxt_s * brc_cxt, size_t src_size) {
+	return brc_init_cxt_with(brc_cxt, src_size, NULL);
+}
+
+int brc_init_cxt_with(brc_cxt_s * brc_cxt, size_t src_size, brc_allocator_s * allocator) {
+	size_t mempool = brc_safe_memory_bound(src_size);
+	brc_cxt->allocator = allocator ? allocator : brc_page_allocator(BRC_PAGES_SMALL);
+	brc_cxt->block = (unsigned char*)brc_cxt->allocator->alloc(brc_cxt->allocator, mempool);
+	brc_cxt->swap = (unsigned char*)brc_cxt->allocator->alloc(brc_cxt->allocator, mempool);
+	brc_cxt->eob = mempool;
+	brc_cxt->capacity = src_size;
+	brc_cxt->scratch = NULL;
+	brc_cxt->shared = NULL;
+	brc_cxt->entropy = 0;
+	brc_cxt->bwt = 0;
+	brc_cxt->sa = NULL;
+	brc_cxt->timings = NULL;
+	brc_cxt->stats = NULL;
+	if(brc_cxt->block == NULL || brc_cxt->swap == NULL) {
+		brc_release_buffers(brc_cxt);
+		return BRC_EXIT_FAILURE;
+	}
+	brc_cxt->size = 0;
+	brc_cxt->segments = 1;
+	brc_cxt->interleave = 1;
+	brc_cxt->level = BRC_MAX_LEVEL;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_resize_cxt(brc_cxt_s * brc_cxt, size_t src_size) {
+	if(src_size <= brc_cxt->capacity) return BRC_EXIT_SUCCESS;
+	size_t mempool = brc_safe_memory_bound(src_size);
+	brc_allocator_s * allocator = brc_cxt->allocator;
+	unsigned char * block = (unsigned char*)allocator->alloc(allocator, mempool);
+	unsigned char * swap = (unsigned char*)allocator->alloc(allocator, mempool);
+	if(block == NULL || swap == NULL) {
+		if(block) allocator->free(allocator, block, mempool);
+		if(swap) allocator->free(allocator, swap, mempool);
+		return BRC_EXIT_FAILURE;
+	}
+	brc_release_buffers(brc_cxt);
+	brc_cxt->block = block;
+	brc_cxt->swap = swap;
+	brc_cxt->size = 0;
+	brc_cxt->eob = mempool;
+	brc_cxt->capacity = src_size;
+	return BRC_EXIT_SUCCESS;
+}
+
+void brc_free_cxt(brc_cxt_s * brc_cxt) {
+	brc_release_buffers(brc_cxt);
+	free(brc_cxt->scratch);
+	brc_cxt->scratch = NULL;
+	brc_cxt->size = 0;
+	brc_cxt->eob = 0;
+	brc_cxt->capacity = 0;
+}
+
+/* adds a packed block to the context's statistics, if it collects them */
+#ifdef BRC_STATS
+static void brc_count_block(brc_cxt_s * brc_cxt, size_t src_size, int flags, int stage, uint64_t * freqs) {
+	brc_stats_s * stats = brc_cxt->stats;
+	if(stats == NULL) return;
+	stats->blocks++;
+	stats->input_bytes += src_size;
+	stats->packed_bytes += brc_cxt->size;
+	for(size_t i = 0; i < 256; i++)
+		stats->unique_symbols += freqs[i] > 0;
+	stats->rlt_fallbacks += (flags & (BRC_BLOCK_RLT | BRC_BLOCK_RUN | BRC_BLOCK_STORED)) == 0;
+	stats->entropy_blocks += (flags & BRC_BLOCK_ENTROPY) != 0;
+	stats->run_blocks += (flags & BRC_BLOCK_RUN) != 0;
+	stats->stored_blocks += (flags & BRC_BLOCK_STORED) != 0;
+	if(!(flags & (BRC_BLOCK_RUN | BRC_BLOCK_STORED))) stats->stages[stage]++;
+}
+#else
+static inline void brc_count_block(brc_cxt_s *, size_t, int, int, uint64_t *) {}
+#endif
+
+/* ranks go to 'swap' and the run length coder packs them back into 'block', no copies in between */
+int brc_encode(brc_cxt_s * brc_cxt, unsigned char * src, size_t src_size) {
+	if(brc_resize_cxt(brc_cxt, src_size) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+
+	size_t segments = brc_cxt->segments > 1 ? brc_cxt->segments : 1;
+	if(segments > vsrc_max_segments(src_size)) segments = vsrc_max_segments(src_size);
+	if(segments > 1 && brc_cxt->scratch == NULL) {
+		brc_cxt->scratch = (brc_scratch_s*)malloc(sizeof(brc_scratch_s));
+		if(brc_cxt->scratch == NULL) return BRC_EXIT_FAILURE;
+	}
+
+	int flags = brc_cxt->shared ? BRC_BLOCK_SHARED : 0;
+	double mark = brc_cxt->timings ? omp_get_wtime() : 0;
+	BRC_STATS_START(brc_cxt);
+
+	/* runs are found before the BWT, which leaves them as they are, and random data after it, as it may find repeats */
+	uint64_t freqs[256];
+	unsigned char * input = src;
+	int plain = brc_histogram(src, src_size, freqs) == 1 ? BRC_BLOCK_RUN : 0;
+	if(!plain && !brc_cxt->bwt && brc_incompressible(freqs, src_size, brc_repeats(src, src_size))) plain = BRC_BLOCK_STORED;
+
+	/* the transform goes to 'block', which is free until the run length coder fills it; one thread per segment undoes it */
+	uint32_t rows[BRC_MAX_SEGMENTS];
+	size_t num_rows = segments * BWT_CHAINS < BRC_MAX_SEGMENTS ? segments * BWT_CHAINS : BRC_MAX_SEGMENTS;
+	if(num_rows > src_size) num_rows = src_size;
+	if(brc_cxt->bwt && src_size > 0 && !plain) {
+		if(src_size > BWT_MAX_SIZE) 
+			return printf(" Block too large for the BWT! \n"), BRC_EXIT_FAILURE;
+		if(brc_alloc_sa(brc_cxt) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+		if(bwt_forward(src, brc_cxt->block, src_size, brc_cxt->sa, rows, num_rows) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+		src = brc_cxt->block;
+		flags |= BRC_BLOCK_BWT;
+		BRC_LAP(brc_cxt, bwt_forwards, mark);
+		if(brc_incompressible(freqs, src_size, brc_repeats(src, src_size))) plain = BRC_BLOCK_STORED;
+	}
+
+	if(plain) {
+		brc_cxt->size = brc_pack_plain(input, src_size, plain, brc_cxt->block);
+		brc_count_block(brc_cxt, src_size, plain, BRC_STAGE_RANK, freqs);
+		return BRC_EXIT_SUCCESS;
+	}
+
+	/* the faster stages have no tables, and the last one can code the input in place unless the BWT put it in 'block' */
+	int stage = brc_choose_stage(brc_cxt, src, src_size);
+	unsigned char * ranks = brc_cxt->swap;
+	size_t dst_size = src_size;
+	if(stage == BRC_STAGE_NONE && src != brc_cxt->block) 
+		ranks = src;
+	else if(stage != BRC_STAGE_RANK) 
+		stage_forwards(stage, src, ranks, src_size);
+	else if(segments > 1) 
+		dst_size = vsrc_forwards_segmented(src, ranks, src_size, segments, brc_cxt->scratch, brc_cxt->shared, &flags);
+	else 
+		dst_size = vsrc_forwards(src, ranks, src_size, freqs, brc_cxt->shared, &flags);
+	if(stage != BRC_STAGE_RANK) flags |= BRC_BLOCK_STAGE;
+	BRC_LAP(brc_cxt, vsrc_forwards, mark);
+
+#ifdef BRC_STATS
+	/* counted outside the stages so neither the cycles nor the timings include it */
+	if(brc_cxt->stats) {
+		brc_stats_s * stats = brc_cxt->stats;
+		for(size_t i = 0; i < src_size; i++)
+			stats->ranks[ranks[i]]++;
+		rlt_stats(ranks, dst_size, stats);
+		if(brc_cxt->timings) mark = omp_get_wtime();
+		BRC_STATS_START(brc_cxt);
+	}
+#endif
+
+	size_t payload = rlt_forwards(ranks, brc_cxt->block, dst_size) - BRC_RLT_FOOTER_SIZE;
+	flags |= brc_cxt->block[payload];
+	BRC_LAP(brc_cxt, rlt_forwards, mark);
+
+	/* the entropy coder writes into 'swap' and the buffers trade places if that came out smaller */
+	if(brc_cxt->entropy) {
+		size_t packed = rans_encode(brc_cxt->block, payload, brc_cxt->swap, payload);
+		if(packed > 0) {
+			unsigned char * block = brc_cxt->swap;
+			brc_cxt->swap = brc_cxt->block;
+			brc_cxt->block = block;
+			payload = packed;
+			flags |= BRC_BLOCK_ENTROPY;
+		}
+		BRC_LAP(brc_cxt, rans_encode, mark);
+	}
+
+	if(flags & BRC_BLOCK_BWT) {
+		memcpy(brc_cxt->block + payload, rows, num_rows * sizeof(uint32_t));
+		payload += num_rows * sizeof(uint32_t);
+		brc_cxt->block[payload++] = num_rows - 1;
+	}
+	if(flags & BRC_BLOCK_STAGE) brc_cxt->block[payload++] = stage;
+	brc_cxt->block[payload] = flags;
+	brc_cxt->size = payload + BRC_RLT_FOOTER_SIZE;
+	brc_count_block(brc_cxt, src_size, flags, stage, freqs);
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_decode(brc_cxt_s * brc_cxt, unsigned char * dst, size_t * dst_size) {
+	return brc_decode_from(brc_cxt, brc_cxt->block, brc_cxt->size, dst, brc_cxt->capacity, dst_size);
+}
+
+/* a block whose runs are expanded, waiting to be unranked */
+struct brc_pending_s {
+	int flags;
+	unsigned char * ranks; /* NULL once unranked: run, stored and fused blocks */
+	size_t ranks_size;
+	unsigned char * out; /* where the ranks are unranked to, 'dst' or the spare buffer of a BWT block */
+	uint32_t rows[BRC_MAX_SEGMENTS];
+	size_t num_rows;
+	double mark;
+};
+
+/*
+	Runs are expanded into 'swap' and unranked straight into 'dst'. An entropy coded block is first decoded
+	into 'swap' and its runs expanded into 'block', and a BWT block is unranked into whichever buffer is
+	free by then before the inverse BWT writes 'dst'.
+*/
+static int brc_decode_runs(brc_cxt_s * brc_cxt, unsigned char * src, size_t src_size, unsigned char * dst, size_t dst_capacity, brc_pending_s * pending) {
+	if(src_size < BRC_RLT_FOOTER_SIZE || src_size > brc_cxt->eob) return BRC_EXIT_FAILURE;
+	size_t payload = src_size - BRC_RLT_FOOTER_SIZE;
+	int flags = src[payload];
+	pending->flags = flags;
+	pending->mark = brc_cxt->timings ? omp_get_wtime() : 0;
+	BRC_STATS_START(brc_cxt);
+
+	/* runs and stored blocks go straight to 'dst' and leave no ranks */
+	if(flags & (BRC_BLOCK_RUN | BRC_BLOCK_STORED)) {
+		uint64_t size = payload;
+		if(flags & BRC_BLOCK_RUN) {
+			unsigned char * symbol = brc_get_varint(src, src + payload, &size);
+			if(symbol == NULL || symbol + 1 != src + payload || size > dst_capacity)
+				return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+			memset(dst, *symbol, size);
+		} else {
+			if(size > dst_capacity)
+				return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+			memcpy(dst, src, size);
+		}
+		pending->flags = flags & (BRC_BLOCK_RUN | BRC_BLOCK_STORED);
+		pending->ranks = NULL;
+		pending->ranks_size = size;
+		return BRC_EXIT_SUCCESS;
+	}
+
+	int stage = BRC_STAGE_RANK;
+	if(flags & BRC_BLOCK_STAGE) {
+		if(payload < 1 || src[payload - 1] == BRC_STAGE_RANK || src[payload - 1] >= BRC_STAGES) 
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		stage = src[--payload];
+	}
+
+	pending->num_rows = 0;
+	if(flags & BRC_BLOCK_BWT) {
+		if(payload < 1) 
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		pending->num_rows = (size_t)src[payload - 1] + 1;
+		if(payload < 1 + pending->num_rows * sizeof(uint32_t)) 
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		payload -= 1 + pending->num_rows * sizeof(uint32_t);
+		memcpy(pending->rows, src + payload, pending->num_rows * sizeof(uint32_t));
+	}
+
+	unsigned char * ranks = brc_cxt->swap, * spare = brc_cxt->block;
+	if(flags & BRC_BLOCK_ENTROPY) {
+		if(rans_decode(src, payload, brc_cxt->swap, brc_cxt->eob, &payload) == BRC_EXIT_FAILURE)
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		src = brc_cxt->swap;
+		ranks = brc_cxt->block;
+		spare = brc_cxt->swap;
+		BRC_LAP(brc_cxt, rans_decode, pending->mark);
+	}
+
+	/* ranks mostly in runs skip the expansion, the buffer it would have gone to takes a BWT block's symbols */
+	size_t capacity = (flags & BRC_BLOCK_BWT) && brc_cxt->capacity < dst_capacity ? brc_cxt->capacity : dst_capacity;
+	if((flags & BRC_BLOCK_RLT) && stage == BRC_STAGE_RANK && payload <= capacity / VSRC_FUSED_RATIO) {
+		size_t decoded_size;
+		unsigned char * out = (flags & BRC_BLOCK_BWT) ? ranks : dst;
+		int status = vsrc_reverse_fused(src, payload, out, capacity, flags, brc_cxt->shared, &decoded_size);
+		if(status == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+		if(status == BRC_EXIT_SUCCESS) {
+			BRC_LAP(brc_cxt, vsrc_reverse, pending->mark);
+			pending->ranks = NULL;
+			pending->ranks_size = decoded_size;
+			pending->out = out;
+			return BRC_EXIT_SUCCESS;
+		}
+	}
+
+	/* the faster stages are undone right away; with no stage at all the runs are expanded where the symbols go */
+	if(stage != BRC_STAGE_RANK) {
+		unsigned char * out = (flags & BRC_BLOCK_BWT) ? spare : dst;
+		if(stage == BRC_STAGE_NONE) out = (flags & BRC_BLOCK_BWT) ? ranks : dst;
+		unsigned char * expanded = stage == BRC_STAGE_NONE ? out : ranks;
+		/* runs expanded into the context's own buffers stay within its capacity, whatever 'dst' holds */
+		size_t expand_capacity = expanded != dst && brc_cxt->capacity < capacity ? brc_cxt->capacity : capacity;
+		size_t size = rlt_reverse(src, expanded, payload, expand_capacity, flags);
+		if(size == 0) 
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		BRC_LAP(brc_cxt, rlt_reverse, pending->mark);
+		stage_reverse(stage, expanded, out, size);
+		BRC_LAP(brc_cxt, vsrc_reverse, pending->mark);
+		pending->ranks = NULL;
+		pending->ranks_size = size;
+		pending->out = out;
+		return BRC_EXIT_SUCCESS;
+	}
+
+	size_t origin_size = rlt_reverse(src, ranks, payload, brc_cxt->eob, flags);
+	if(origin_size == 0) 
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+	BRC_LAP(brc_cxt, rlt_reverse, pending->mark);
+	size_t decoded_size = vsrc_decoded_size(ranks, origin_size, flags);
+	if(decoded_size > dst_capacity || ((flags & BRC_BLOCK_BWT) && decoded_size > brc_cxt->capacity)) 
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+
+	pending->ranks = ranks;
+	pending->ranks_size = origin_size;
+	pending->out = (flags & BRC_BLOCK_BWT) ? spare : dst;
+	return BRC_EXIT_SUCCESS;
+}
+
+/* inverts the BWT of an unranked block of 'origin_size' bytes, if it had one */
+static int brc_decode_finish(brc_cxt_s * brc_cxt, brc_pending_s * pending, unsigned char * dst, size_t origin_size, size_t * dst_size) {
+	if(pending->flags & BRC_BLOCK_BWT) {
+		if(brc_alloc_sa(brc_cxt) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+		if(bwt_reverse(pending->out, dst, origin_size, brc_cxt->sa, pending->rows, pending->num_rows) == BRC_EXIT_FAILURE)
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		BRC_LAP(brc_cxt, bwt_reverse, pending->mark);
+	}
+	*dst_size = origin_size;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_decode_from(brc_cxt_s * brc_cxt, unsigned char * src, size_t src_size, unsigned char * dst, size_t dst_capacity, size_t * dst_size) {
+	brc_pending_s pending;
+	size_t origin_size;
+	if(brc_decode_runs(brc_cxt, src, src_size, dst, dst_capacity, &pending) == BRC_EXIT_FAILURE)
+		return BRC_EXIT_FAILURE;
+	if(pending.ranks == NULL) 
+		return brc_decode_finish(brc_cxt, &pending, dst, pending.ranks_size, dst_size);
+	if(vsrc_reverse(pending.ranks, pending.out, pending.ranks_size, pending.flags, brc_cxt->shared, brc_cxt->interleave, &origin_size) == BRC_EXIT_FAILURE) 
+		return BRC_EXIT_FAILURE;
+	BRC_LAP(brc_cxt, vsrc_reverse, pending.mark);
+	return brc_decode_finish(brc_cxt, &pending, dst, origin_size, dst_size);
+}
+
+/* every block is taken up to its ranks on its own, then all of them are unranked at once and share the time spent on that */
+int brc_decode_interleaved(brc_cxt_s * cxts, brc_job_s * jobs, size_t num_jobs) {
+	if(num_jobs > BRC_MAX_INTERLEAVE) return BRC_EXIT_FAILURE;
+	brc_pending_s pending[BRC_MAX_INTERLEAVE];
+	vsrc_chain_s chains[BRC_MAX_INTERLEAVE];
+	size_t origin_size[BRC_MAX_INTERLEAVE];
+
+	for(size_t j = 0; j < num_jobs; j++) {
+		jobs[j].dst_size = 0;
+		jobs[j].status = brc_decode_runs(&cxts[j], jobs[j].src, jobs[j].src_size, jobs[j].dst, jobs[j].dst_capacity, &pending[j]);
+	}
+
+	double mark = omp_get_wtime();
+	for(size_t j = 0; j < num_jobs; j++) {
+		chains[j].size = 0;
+		origin_size[j] = pending[j].ranks_size;
+		if(jobs[j].status == BRC_EXIT_SUCCESS && pending[j].ranks)
+			jobs[j].status = vsrc_reverse_begin(pending[j].ranks, pending[j].out, pending[j].ranks_size, pending[j].flags, 
+				cxts[j].shared, cxts[j].interleave, &chains[j], &origin_size[j]);
+	}
+	vsrc_symbols_interleaved(chains, num_jobs);
+	double now = omp_get_wtime();
+
+	int err = BRC_EXIT_SUCCESS;
+	for(size_t j = 0; j < num_jobs; j++) {
+		brc_job_s * job = &jobs[j];
+		if(job->status == BRC_EXIT_SUCCESS) {
+			if(cxts[j].timings) cxts[j].timings->vsrc_reverse += (now - mark) / num_jobs, pending[j].mark = now;
+			BRC_STATS_LAP(&cxts[j], vsrc_reverse);
+			job->status = brc_decode_finish(&cxts[j], &pending[j], job->dst, origin_size[j], &job->dst_size);
+		}
+		if(job->status == BRC_EXIT_FAILURE) err = BRC_EXIT_FAILURE;
+	}
+	return err;
+}
+
+/*** in place coding ***/
+/*
+	The sorted rank transform scatters every rank into its symbol's bucket, so it needs the input and its
+	ranks side by side. Move to front, the runs stage and no stage at all write rank i where byte i was,
+	after reading it, and the run length coder never writes more than it has read except for an escape,
+	two bytes for one, which brings its write head a byte closer to the read head. So brc_encode_inplace gives
+	each block one of those stages and codes it over itself when a dry run shows the write head never
+	passes the read head; otherwise the ranks are kept as they are. To expand a block in place, the
+	coded stream is first moved to the end of the buffer and the runs are expanded into its start, which
+	works as long as the expansion never gets ahead of the bytes read by more than the room in front of
+	the stream. The encoder checks that for a buffer of brc_inplace_bound bytes and the decoder again
+	for the one it is given.
+*/
+/* the coded size of 'size' ranks if they can be coded in place and expanded in place within 'capacity' bytes, and they shrink; else 0 */
+static size_t rlt_inplace_size(unsigned char * src, size_t size, size_t capacity) {
+	size_t i = 0, w = 0, ahead = 0;
+	while(i < size) {
+		size_t run = 0;
+		while(i + run < size && src[i + run] == 0)
+			run++;
+		if(run > 0) w += brc_bsr(run + 1), i += run;
+		else w += src[i] >= 0xfe ? 2 : 1, i++;
+		if(w > i) return 0;
+		if(i - w > ahead) ahead = i - w;
+	}
+	return w < size && w + ahead <= capacity ? w : 0;
+}
+
+/* the expanded size of 'size' coded bytes if they can be expanded from the end of 'capacity' bytes into their start, else 0 */
+static size_t rlt_inplace_expanded(unsigned char * src, size_t size, size_t capacity) {
+	size_t i = 0, n = 0, ahead = 0;
+	while(i < size) {
+		if(src[i] == 0xff) {
+			i += 2, n++;
+		} else if(src[i] > 1) {
+			i++, n++;
+		} else {
+			size_t rle = 1, bits = 0;
+			while (i < size && src[i] <= 1 && bits++ < 63)
+				rle = (rle << 1) | src[i++];
+			n += rle - 1;
+		}
+		if(n > capacity) return 0;
+		if(n > i && n - i > ahead) ahead = n - i;
+	}
+	return i == size && size + ahead <= capacity ? n : 0;
+}
+
+size_t brc_inplace_bound(size_t x) {
+	return x + BRC_INPLACE_PAD_SIZE;
+}
+
+int brc_encode_inplace(unsigned char * buf, size_t src_size, size_t capacity, int level, size_t * packed_size) {
+	if(capacity < brc_inplace_bound(src_size)) return BRC_EXIT_FAILURE;
+
+	uint64_t freqs[256];
+	if(brc_histogram(buf, src_size, freqs) == 1) {
+		unsigned char symbol = buf[0];
+		*packed_size = brc_pack_plain(&symbol, src_size, BRC_BLOCK_RUN, buf);
+		return BRC_EXIT_SUCCESS;
+	}
+	if(src_size == 0 || brc_incompressible(freqs, src_size, brc_repeats(buf, src_size))) {
+		buf[src_size] = BRC_BLOCK_STORED;
+		*packed_size = src_size + BRC_RLT_FOOTER_SIZE;
+		return BRC_EXIT_SUCCESS;
+	}
+
+	/* move to front is the closest the in place stages come to the sorted rank transform, so it stands in for it at BRC_MAX_LEVEL */
+	int stage = BRC_STAGE_MTF;
+	if(level < BRC_MAX_LEVEL) {
+		unsigned char scratch[BRC_INPLACE_SAMPLE_SIZE];
+		size_t n = src_size < BRC_INPLACE_SAMPLE_SIZE ? src_size : BRC_INPLACE_SAMPLE_SIZE;
+		stage = brc_pick_stage(buf + (src_size - n) / 2, n, scratch, BRC_STAGE_MTF, level, 0, NULL);
+	}
+	stage_forwards(stage, buf, buf, src_size);
+
+	/* the vector run length coders store spans ahead of where they read, so only the bytewise one codes in place */
+	int flags = BRC_BLOCK_STAGE;
+	size_t payload = src_size;
+	if(rlt_inplace_size(buf, src_size, brc_inplace_bound(src_size)) > 0) {
+		payload = rlt_forwards_std(buf, buf, src_size) - BRC_RLT_FOOTER_SIZE;
+		flags |= BRC_BLOCK_RLT;
+	}
+	buf[payload++] = stage;
+	buf[payload] = flags;
+	*packed_size = payload + BRC_RLT_FOOTER_SIZE;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_decode_inplace(unsigned char * buf, size_t packed_size, size_t capacity, size_t * dst_size) {
+	if(packed_size < BRC_RLT_FOOTER_SIZE || packed_size > capacity) return BRC_EXIT_FAILURE;
+	size_t payload = packed_size - BRC_RLT_FOOTER_SIZE;
+	int flags = buf[payload];
+
+	if(flags & BRC_BLOCK_RUN) {
+		uint64_t size;
+		unsigned char * symbol = brc_get_varint(buf, buf + payload, &size);
+		if(symbol == NULL || symbol + 1 != buf + payload || size > capacity)
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+		memset(buf, *symbol, size);
+		*dst_size = size;
+		return BRC_EXIT_SUCCESS;
+	}
+	if(flags & BRC_BLOCK_STORED) {
+		*dst_size = payload;
+		return BRC_EXIT_SUCCESS;
+	}
+
+	if(!(flags & BRC_BLOCK_STAGE) || (flags & (BRC_BLOCK_ENTROPY | BRC_BLOCK_BWT)))
+		return printf(" Block cannot be decoded in place! \n"), BRC_EXIT_FAILURE;
+	if(payload < 1 || buf[payload - 1] == BRC_STAGE_RANK || buf[payload - 1] >= BRC_STAGES) 
+		return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+	int stage = buf[--payload];
+
+	size_t size = payload;
+	if(flags & BRC_BLOCK_RLT) {
+		size = rlt_inplace_expanded(buf, payload, capacity);
+		if(size == 0)
+			return printf(" Block cannot be decoded in place! \n"), BRC_EXIT_FAILURE;
+		unsigned char * coded = buf + capacity - payload;
+		memmove(coded, buf, payload);
+		if(rlt_reverse_std(coded, buf, payload, capacity) != size)
+			return printf(" Invalid sub header detected! \n"), BRC_EXIT_FAILURE;
+	}
+	stage_reverse(stage, buf, buf, size);
+	*dst_size = size;
+	return BRC_EXIT_SUCCESS;
+}
+
+void brc_build_shared(brc_shared_s * shared, unsigned char * sample, size_t size) {
+	uint64_t freqs[256] = {0};
+	for(size_t i = 0; i < size; i++)
+		freqs[sample[i]]++;
+	shared->num_symbols = generate_sorted_map(freqs, shared->order);
+}
@@ -1,33 +1,198 @@
-/*
-	BRC - Behemoth Rank Coding for BWT
-	MIT License
-	Copyright (c) 2018 Lucas Marsh
-	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
-	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
-	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-*/
-#pragma once
-
-#include "common.hpp"
-
-#define BRC_VERSION 4
-#define BRC_EXIT_SUCCESS 0
-#define BRC_EXIT_FAILURE -1
-
-struct brc_cxt_s {
-	unsigned char * block; 
-	size_t size;
-	size_t eob;
-};
-
-/* allocate memory for BRC encoder or decoder */
-int brc_init_cxt(brc_cxt_s * brc_cxt, size_t src_size);
-
-/* free all memory associated with brc */
-void brc_free_cxt(brc_cxt_s * brc_cxt);
-
-/* generates BRC block transform from 'src' and stores it in 'brc_cxt'; returns 0 for successful encode, else -1 */
-int brc_encode(brc_cxt_s * brc_cxt, unsigned char * src, size_t src_size);
-
-/* undoes BRC block transform from 'brc_cxt' and stores it in 'dst'; returns 0 for successful encode, else -1 */
-int brc_decode(brc_cxt_s * brc_cxt, unsigned char * dst, size_t * dst_size);
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "common.hpp"
+
+#define BRC_VERSION 8
+#define BRC_EXIT_SUCCESS 0
+#define BRC_EXIT_FAILURE -1
+#define BRC_MAX_INTERLEAVE 4 /* most blocks or segments one thread decodes together */
+#define BRC_MAX_LEVEL 4 /* levels below it may pick a faster rank stage per block, at it blocks always take the sorted rank transform */
+
+/* rank stages a block can go through, fastest last */
+#define BRC_STAGE_RANK 0 /* sorted rank transform */
+#define BRC_STAGE_MTF 1 /* move to front */
+#define BRC_STAGE_RUNS 2 /* repeats of the previous byte become zeros, other bytes keep their value */
+#define BRC_STAGE_NONE 3 /* bytes go to the run length coder as they are */
+#define BRC_STAGES 4
+
+struct brc_scratch_s;
+
+/*
+	Where a context's buffers come from: 'alloc' returns at least 'bytes' bytes aligned to 64 or NULL, and
+	'free' gets the same size back. Implementations called from several threads must be thread safe.
+*/
+struct brc_allocator_s {
+	void * (*alloc)(brc_allocator_s * allocator, size_t bytes);
+	void (*free)(brc_allocator_s * allocator, void * ptr, size_t bytes);
+	void * opaque;
+};
+
+/* built in allocators, see brc_page_allocator */
+#define BRC_PAGES_SMALL 0 /* malloc, 64 byte aligned; the default */
+#define BRC_PAGES_THP 1 /* mapped pages, 2MB aligned and advised for transparent huge pages from 1MB up, touched by the allocating thread */
+#define BRC_PAGES_HUGE 2 /* same, from explicitly reserved huge pages while there are any */
+
+/* bucket order shared by a batch of similar blocks so each one skips its own sort; build it with brc_build_shared */
+struct brc_shared_s {
+	unsigned char order[256]; /* symbols by descending frequency */
+	int num_symbols;
+};
+
+/* wall clock seconds spent in each stage, added up over every block coded while a context points here */
+struct brc_timings_s {
+	double bwt_forwards, vsrc_forwards, rlt_forwards, rans_encode;
+	double rans_decode, rlt_reverse, vsrc_reverse, bwt_reverse;
+};
+
+/* cycle counter ticks per stage, same stages as brc_timings_s */
+struct brc_cycles_s {
+	uint64_t bwt_forwards, vsrc_forwards, rlt_forwards, rans_encode;
+	uint64_t rans_decode, rlt_reverse, vsrc_reverse, bwt_reverse;
+};
+
+/*
+	What the stages saw, added up over every block coded while a context points here; clear it between
+	blocks for per block figures. Only collected when the library is built with BRC_STATS defined.
+*/
+struct brc_stats_s {
+	uint64_t blocks, input_bytes, packed_bytes;
+	uint64_t unique_symbols; /* distinct bytes per block */
+	uint64_t ranks[256]; /* histogram of the ranks out of the rank stage */
+	uint64_t zero_runs[64]; /* zero runs by the number of bytes the run length coder spends on them, one byte first */
+	uint64_t escapes_fe, escapes_ff; /* ranks 0xfe and 0xff, which take two bytes each */
+	uint64_t rlt_fallbacks; /* blocks the run length coder stored as they were */
+	uint64_t entropy_blocks; /* blocks the rANS stage made smaller */
+	uint64_t run_blocks; /* blocks of one symbol, stored as a run */
+	uint64_t stored_blocks; /* blocks the pre-scan found incompressible and stored as they were */
+	uint64_t stages[BRC_STAGES]; /* blocks by the rank stage they took, see BRC_STAGE_* */
+	brc_cycles_s cycles;
+	uint64_t mark; /* cycle counter at the end of the last stage */
+};
+
+struct brc_cxt_s {
+	unsigned char * block; /* packed block */
+	unsigned char * swap; /* ranks between the two stages */
+	size_t size;
+	size_t eob;
+	size_t capacity; /* largest block the buffers are sized for */
+	int segments; /* encode blocks as up to this many segments which encode and decode on separate threads, 1 by default */
+	int interleave; /* decode up to this many segments of a block together on each thread, 1 by default */
+	int level; /* 1 to BRC_MAX_LEVEL, lower levels trade ratio for speed block by block; BRC_MAX_LEVEL by default */
+	brc_scratch_s * scratch; /* segment tables, allocated on first use */
+	int entropy; /* order-0 rANS after the run length coder whenever it makes the block smaller, 0 by default */
+	int bwt; /* BWT the block before ranking it and invert it after decoding, 0 by default as input is expected to be BWT output already */
+	int32_t * sa; /* suffix array of the BWT, allocated on first use */
+	brc_timings_s * timings; /* optional per stage timings, NULL by default */
+	brc_stats_s * stats; /* optional statistics, NULL by default and ignored unless built with BRC_STATS */
+	brc_shared_s * shared; /* optional table for a batch of blocks, decoding needs the one they were encoded with; NULL by default */
+	brc_allocator_s * allocator; /* where 'block', 'swap' and 'sa' come from, set by brc_init_cxt_with */
+};
+
+/* one block of a batch; encoding needs brc_safe_memory_bound(src_size) bytes of 'dst', decoding the original size */
+struct brc_job_s {
+	unsigned char * src;
+	size_t src_size;
+	unsigned char * dst;
+	size_t dst_capacity;
+	size_t dst_size; /* bytes written to 'dst' */
+	int status; /* 0 on success, else -1 */
+};
+
+/* largest size a block of 'x' bytes can occupy once packed by brc_encode */
+size_t brc_safe_memory_bound(size_t x);
+
+/* allocate memory for BRC encoder or decoder */
+int brc_init_cxt(brc_cxt_s * brc_cxt, size_t src_size);
+
+/* same with buffers from 'allocator', NULL for BRC_PAGES_SMALL; with a page allocator the calling thread's NUMA node holds them */
+int brc_init_cxt_with(brc_cxt_s * brc_cxt, size_t src_size, brc_allocator_s * allocator);
+
+/* one of the BRC_PAGES_* allocators, static and thread safe */
+brc_allocator_s * brc_page_allocator(int pages);
+
+/*
+	A pool over 'backing' (NULL for BRC_PAGES_SMALL) that keeps freed buffers and hands them out again to
+	threads on the NUMA node that allocated them, for the same size. Idle buffers of a size go back to
+	'backing' once no buffer of that size is in use; destroy the pool once the contexts using it are freed.
+*/
+brc_allocator_s * brc_pool_create(brc_allocator_s * backing);
+void brc_pool_destroy(brc_allocator_s * pool);
+
+/* NUMA node of the cpu the calling thread runs on, 0 where it cannot be told */
+int brc_current_node();
+
+/* grows the buffers so blocks of 'src_size' bytes fit, never shrinks; brc_encode calls this itself so steady state encoding does not allocate */
+int brc_resize_cxt(brc_cxt_s * brc_cxt, size_t src_size);
+
+/* free all memory associated with brc */
+void brc_free_cxt(brc_cxt_s * brc_cxt);
+
+/* generates BRC block transform from 'src' and stores it in 'brc_cxt'; returns 0 for successful encode, else -1 */
+int brc_encode(brc_cxt_s * brc_cxt, unsigned char * src, size_t src_size);
+
+/* undoes BRC block transform from 'brc_cxt' and stores it in 'dst'; returns 0 for successful encode, else -1 */
+int brc_decode(brc_cxt_s * brc_cxt, unsigned char * dst, size_t * dst_size);
+
+/* same as brc_decode but reads the packed block from 'src' instead of 'brc_cxt', e.g. straight from a mapped file; fails if more than 'dst_capacity' bytes would be written */
+int brc_decode_from(brc_cxt_s * brc_cxt, unsigned char * src, size_t src_size, unsigned char * dst, size_t dst_capacity, size_t * dst_size);
+
+/*
+	decodes up to BRC_MAX_INTERLEAVE blocks on the calling thread, jobs[i] with cxts[i], unranking them in
+	lockstep so their dependency chains overlap; returns 0 if every job succeeded, else -1
+*/
+int brc_decode_interleaved(brc_cxt_s * cxts, brc_job_s * jobs, size_t num_jobs);
+
+/* capacity brc_encode_inplace and brc_decode_inplace need for a block of 'x' bytes */
+size_t brc_inplace_bound(size_t x);
+
+/*
+	Low memory coding: packs the 'src_size' bytes at 'buf' over themselves, using no memory but a few KB of
+	stack where brc_encode needs two more buffers of the block size. 'capacity' is at least
+	brc_inplace_bound(src_size). The sorted rank transform cannot run in place, so blocks take move to front
+	instead, or at levels below BRC_MAX_LEVEL whichever of the faster stages the level picks, and come out
+	somewhat larger than brc_encode's. brc_decode and brc_decode_from decode them too. Returns 0 on success, else -1.
+*/
+int brc_encode_inplace(unsigned char * buf, size_t src_size, size_t capacity, int level, size_t * packed_size);
+
+/*
+	Unpacks a block of 'packed_size' bytes at 'buf' over itself within 'capacity' bytes, brc_inplace_bound of
+	the original size being always enough for brc_encode_inplace's blocks. Blocks brc_encode ranked with the
+	sorted rank transform, entropy coded or BWT transformed fail; returns 0 on success, else -1.
+*/
+int brc_decode_inplace(unsigned char * buf, size_t packed_size, size_t capacity, size_t * dst_size);
+
+/*
+	Approximate size brc_encode packs 'src' into at BRC_MAX_LEVEL without the BWT, after the rANS stage when
+	'entropy' is set, from the runs of the block and a few ranked windows; writes nothing and runs many times faster than encoding
+*/
+size_t brc_estimate(unsigned char * src, size_t size, int entropy);
+
+/*
+	Where a block taken from the 'size' bytes at 'src' should end so the statistics on either side stay
+	apart: a point where the byte histogram shifts and brc_estimate finds both sides smaller coded apart, with
+	at least 'min_size' bytes on each side, else 'size'
+*/
+size_t brc_split(unsigned char * src, size_t size, size_t min_size, int entropy);
+
+/* fills 'shared' from a sample of the batch, e.g. its first block */
+void brc_build_shared(brc_shared_s * shared, unsigned char * sample, size_t size);
+
+/* true when the library was built with BRC_STATS and fills brc_cxt_s::stats */
+bool brc_stats_enabled();
+
+/* highest kernel set the BRC_SIMD environment variable allows: 0 std, 1 sse2, 2 avx2, 3 no cap */
+int brc_simd_cap();
+
+/* name of the SIMD kernel set selected for this cpu at runtime ("avx512bw", "avx2", "sse2" or "std") */
+const char * brc_simd_name();
+
+/* CRC32C of 'size' bytes at 'src', with the crc32 instruction where the cpu has SSE4.2 */
+uint32_t brc_checksum(const unsigned char * src, size_t size);
@@ -0,0 +1,209 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "bwt.hpp"
+#include "brc.hpp"
+
+/*** suffix array by induced sorting (Nong, Zhang and Chan, 2009) ***/
+/* symbol 'i' of a level: bytes are shifted up by one behind a virtual sentinel 0, deeper levels are int32 names */
+static inline int32_t sais_chr(const void * s, int32_t i, int32_t n, int cs) {
+	if(cs == sizeof(int32_t)) return ((const int32_t*)s)[i];
+	return i == n - 1 ? 0 : ((const unsigned char*)s)[i] + 1;
+}
+
+/* bit i of 't' is set for S-type suffixes */
+static inline bool sais_tget(const unsigned char * t, int32_t i) {
+	return (t[i >> 3] >> (i & 7)) & 1;
+}
+
+static inline void sais_tset(unsigned char * t, int32_t i, bool b) {
+	if(b) t[i >> 3] |= 1 << (i & 7);
+	else t[i >> 3] &= ~(1 << (i & 7));
+}
+
+static inline bool sais_lms(const unsigned char * t, int32_t i) {
+	return i > 0 && sais_tget(t, i) && !sais_tget(t, i - 1);
+}
+
+static void sais_buckets(const void * s, int32_t * bkt, int32_t n, int32_t k, int cs, bool end) {
+	int32_t sum = 0;
+	for(int32_t i = 0; i <= k; i++) bkt[i] = 0;
+	for(int32_t i = 0; i < n; i++) bkt[sais_chr(s, i, n, cs)]++;
+	for(int32_t i = 0; i <= k; i++) {
+		sum += bkt[i];
+		bkt[i] = end ? sum : sum - bkt[i];
+	}
+}
+
+static void sais_induce(const unsigned char * t, int32_t * sa, const void * s, int32_t * bkt, int32_t n, int32_t k, int cs) {
+	sais_buckets(s, bkt, n, k, cs, false);
+	for(int32_t i = 0; i < n; i++) {
+		int32_t j = sa[i] - 1;
+		if(j >= 0 && !sais_tget(t, j)) sa[bkt[sais_chr(s, j, n, cs)]++] = j;
+	}
+	sais_buckets(s, bkt, n, k, cs, true);
+	for(int32_t i = n - 1; i >= 0; i--) {
+		int32_t j = sa[i] - 1;
+		if(j >= 0 && sais_tget(t, j)) sa[--bkt[sais_chr(s, j, n, cs)]] = j;
+	}
+}
+
+/* suffix array of 's' whose last symbol is a unique smallest sentinel, symbols range over 0..k */
+static int sais(const void * s, int32_t * sa, int32_t n, int32_t k, int cs) {
+	unsigned char * t = (unsigned char*)calloc(n / 8 + 1, 1); /* sais_tset only flips single bits */
+	int32_t * bkt = (int32_t*)malloc(sizeof(int32_t) * (k + 1));
+	if(t == NULL || bkt == NULL)
+		return free(t), free(bkt), BRC_EXIT_FAILURE;
+
+	sais_tset(t, n - 1, 1);
+	if(n > 1) sais_tset(t, n - 2, 0);
+	for(int32_t i = n - 3; i >= 0; i--) {
+		int32_t a = sais_chr(s, i, n, cs), b = sais_chr(s, i + 1, n, cs);
+		sais_tset(t, i, a < b || (a == b && sais_tget(t, i + 1)));
+	}
+
+	/* sort the LMS substrings */
+	sais_buckets(s, bkt, n, k, cs, true);
+	for(int32_t i = 0; i < n; i++) sa[i] = -1;
+	for(int32_t i = 1; i < n; i++)
+		if(sais_lms(t, i)) sa[--bkt[sais_chr(s, i, n, cs)]] = i;
+	sais_induce(t, sa, s, bkt, n, k, cs);
+	free(bkt);
+
+	/* compact them into the front and name them, equal substrings share a name */
+	int32_t n1 = 0;
+	for(int32_t i = 0; i < n; i++)
+		if(sais_lms(t, sa[i])) sa[n1++] = sa[i];
+	for(int32_t i = n1; i < n; i++) sa[i] = -1;
+	int32_t name = 0, prev = -1;
+	for(int32_t i = 0; i < n1; i++) {
+		int32_t pos = sa[i];
+		bool diff = false;
+		for(int32_t d = 0; d < n; d++) {
+			if(prev == -1 || sais_chr(s, pos + d, n, cs) != sais_chr(s, prev + d, n, cs) || sais_tget(t, pos + d) != sais_tget(t, prev + d)) {
+				diff = true;
+				break;
+			} else if(d > 0 && (sais_lms(t, pos + d) || sais_lms(t, prev + d))) break;
+		}
+		if(diff) name++, prev = pos;
+		sa[n1 + pos / 2] = name - 1;
+	}
+	for(int32_t i = n - 1, j = n - 1; i >= n1; i--)
+		if(sa[i] >= 0) sa[j--] = sa[i];
+
+	/* sort the reduced string, recursing while names repeat */
+	int32_t * sa1 = sa, * s1 = sa + n - n1;
+	if(name < n1) {
+		if(sais(s1, sa1, n1, name - 1, sizeof(int32_t)) == BRC_EXIT_FAILURE)
+			return free(t), BRC_EXIT_FAILURE;
+	} else {
+		for(int32_t i = 0; i < n1; i++) sa1[s1[i]] = i;
+	}
+
+	/* place the sorted LMS suffixes in their buckets and induce the rest */
+	bkt = (int32_t*)malloc(sizeof(int32_t) * (k + 1));
+	if(bkt == NULL)
+		return free(t), BRC_EXIT_FAILURE;
+	sais_buckets(s, bkt, n, k, cs, true);
+	for(int32_t i = 1, j = 0; i < n; i++)
+		if(sais_lms(t, i)) s1[j++] = i;
+	for(int32_t i = 0; i < n1; i++) sa1[i] = s1[sa1[i]];
+	for(int32_t i = n1; i < n; i++) sa[i] = -1;
+	for(int32_t i = n1 - 1; i >= 0; i--) {
+		int32_t j = sa[i];
+		sa[i] = -1;
+		sa[--bkt[sais_chr(s, j, n, cs)]] = j;
+	}
+	sais_induce(t, sa, s, bkt, n, k, cs);
+	free(bkt);
+	free(t);
+	return BRC_EXIT_SUCCESS;
+}
+
+/*** burrows wheeler transform ***/
+int bwt_forward(unsigned char * src, unsigned char * dst, size_t size, int32_t * sa, uint32_t * rows, size_t num_rows) {
+	if(size == 0 || size > BWT_MAX_SIZE || num_rows == 0 || size / num_rows == 0) return BRC_EXIT_FAILURE;
+	int32_t n = size + 1;
+	if(sais(src, sa, n, 256, sizeof(unsigned char)) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+
+	/* last column of every row but the primary, whose last symbol is the sentinel */
+	size_t step = size / num_rows;
+	unsigned char * write_head = dst;
+	for(int32_t r = 0; r < n; r++) {
+		size_t s = sa[r];
+		if(s == 0) {
+			rows[0] = r;
+			continue;
+		}
+		*write_head++ = src[s - 1];
+		if(s % step == 0 && s / step < num_rows) rows[s / step] = r;
+	}
+	return BRC_EXIT_SUCCESS;
+}
+
+/*
+	links[i] is the row of the suffix one position after row i's, and the symbol at that position is the
+	last column of the linked row, so following the links from the row of suffix k * step spells out the
+	text from there on.
+*/
+int bwt_reverse(unsigned char * src, unsigned char * dst, size_t size, int32_t * links, uint32_t * rows, size_t num_rows) {
+	if(size == 0 || size > BWT_MAX_SIZE || num_rows == 0 || size / num_rows == 0) return BRC_EXIT_FAILURE;
+	size_t primary = rows[0];
+	if(primary == 0 || primary > size) return BRC_EXIT_FAILURE;
+	for(size_t k = 1; k < num_rows; k++)
+		if(rows[k] > size) return BRC_EXIT_FAILURE;
+
+	size_t bucket[256] = {0};
+	for(size_t i = 0; i < size; i++)
+		bucket[src[i]]++;
+	for(size_t i = 0, sum = 1; i < 256; i++) {
+		size_t count = bucket[i];
+		bucket[i] = sum;
+		sum += count;
+	}
+
+	/* the sentinel sorts first, so row 0 links to the primary row */
+	links[0] = primary;
+	for(size_t j = 0; j < primary; j++)
+		links[bucket[src[j]]++] = j;
+	for(size_t j = primary; j < size; j++)
+		links[bucket[src[j]]++] = j + 1;
+
+	/* each thread follows up to BWT_CHAINS stretches in lockstep so their cache misses overlap */
+	size_t step = size / num_rows, groups = (num_rows + BWT_CHAINS - 1) / BWT_CHAINS;
+	int failed = 0;
+	#pragma omp parallel for num_threads(groups) reduction(|:failed)
+	for(int g = 0; g < (int)groups; g++) {
+		size_t first = g * BWT_CHAINS, count = num_rows - first < BWT_CHAINS ? num_rows - first : BWT_CHAINS;
+		size_t i[BWT_CHAINS];
+		for(size_t c = 0; c < count; c++)
+			i[c] = rows[first + c];
+		for(size_t t = 0; t < step; t++) {
+			for(size_t c = 0; c < count; c++) {
+				i[c] = links[i[c]];
+				dst[(first + c) * step + t] = src[i[c] - (i[c] >= primary)];
+			}
+		}
+
+		/* the last stretch also takes what is left over after num_rows * step */
+		if(first + count == num_rows) {
+			size_t & last = i[count - 1];
+			for(size_t t = num_rows * step; t < size; t++) {
+				last = links[last];
+				dst[t] = src[last - (last >= primary)];
+			}
+		}
+
+		/* every stretch must end where the next one starts, the last one on the sentinel's row */
+		for(size_t c = 0; c < count; c++) {
+			size_t next = (first + c + 1 == num_rows) ? 0 : rows[first + c + 1];
+			failed |= (i[c] != next);
+		}
+	}
+	return failed ? BRC_EXIT_FAILURE : BRC_EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "common.hpp"
+
+/*
+	Burrows Wheeler transform with a virtual sentinel smaller than every byte. Row 0 of the sorted
+	rotations is the sentinel's own, and the row whose last column holds the sentinel (the primary
+	index) is left out of the output, so 'size' bytes transform into 'size' bytes. The suffix array
+	is built with SA-IS in linear time. Besides the primary index the row of every suffix starting at
+	k * (size / num_rows) is kept, so the inverse can follow several stretches of output at once: up to
+	BWT_CHAINS interleaved on each thread, and as many threads as it takes to cover all rows.
+*/
+
+/* largest block the BWT accepts, rows and links are 32 bit */
+#define BWT_MAX_SIZE ((size_t)INT32_MAX - 1)
+
+/* stretches one thread of the inverse follows in lockstep */
+#define BWT_CHAINS (8)
+
+/* transforms 'src' into 'dst'; 'sa' needs size + 1 entries, rows[0] receives the primary index; returns 0 on success, else -1 */
+int bwt_forward(unsigned char * src, unsigned char * dst, size_t size, int32_t * sa, uint32_t * rows, size_t num_rows);
+
+/* inverts the transform using 'links' of size + 1 entries; returns 0 on success, else -1 if the rows do not fit the data */
+int bwt_reverse(unsigned char * src, unsigned char * dst, size_t size, int32_t * links, uint32_t * rows, size_t num_rows);
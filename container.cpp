@@ -0,0 +1,642 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "container.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#define brc_fseek _fseeki64
+#define brc_ftell _ftelli64
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define brc_fseek fseeko
+#define brc_ftell ftello
+#endif
+
+/*** container writer ***/
+size_t brc_file_sink(void * user, const void * data, size_t size) {
+	return fwrite(data, 1, size, (FILE*)user);
+}
+
+size_t brc_mem_sink(void * user, const void * data, size_t size) {
+	brc_mem_sink_s * mem = (brc_mem_sink_s*)user;
+	if(size > mem->capacity - mem->size) return 0;
+	memcpy(mem->data + mem->size, data, size);
+	mem->size += size;
+	return size;
+}
+
+size_t brc_container_bound(size_t size, size_t block_size) {
+	size_t blocks = (size + block_size - 1) / block_size;
+	return sizeof(brc_header_s) + blocks * (sizeof(brc_block_header_s) + brc_safe_memory_bound(block_size) + sizeof(brc_index_entry_s) + sizeof(uint32_t))
+		+ sizeof(brc_block_header_s) + sizeof(brc_trailer_s);
+}
+
+int brc_writer_open(brc_writer_s * writer, brc_sink_fn sink, void * user, size_t block_size, uint16_t flags) {
+	brc_header_s header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BRC_MAGIC, sizeof(BRC_MAGIC));
+	header.version = BRC_CONTAINER_VERSION;
+	header.flags = flags;
+	header.block_size = block_size;
+
+	writer->sink = sink;
+	writer->user = user;
+	writer->offset = sizeof(header);
+	writer->entries = NULL;
+	writer->checksums = NULL;
+	writer->num_blocks = 0;
+	writer->capacity = 0;
+	writer->flags = flags;
+	if(sink(user, &header, sizeof(header)) != sizeof(header)) return BRC_EXIT_FAILURE;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_writer_add_block(brc_writer_s * writer, unsigned char * block, size_t packed_size, size_t original_size, uint32_t checksum) {
+	bool checked = (writer->flags & BRC_FLAG_CHECKSUM) != 0;
+	if(writer->num_blocks == writer->capacity) {
+		size_t capacity = writer->capacity ? writer->capacity * 2 : 256;
+		brc_index_entry_s * entries = (brc_index_entry_s*)realloc(writer->entries, capacity * sizeof(brc_index_entry_s));
+		if(entries == NULL) return BRC_EXIT_FAILURE;
+		writer->entries = entries;
+		if(checked) {
+			uint32_t * checksums = (uint32_t*)realloc(writer->checksums, capacity * sizeof(uint32_t));
+			if(checksums == NULL) return BRC_EXIT_FAILURE;
+			writer->checksums = checksums;
+		}
+		writer->capacity = capacity;
+	}
+	if(checked) writer->checksums[writer->num_blocks] = checksum;
+
+	brc_block_header_s block_header = { packed_size, original_size };
+	brc_index_entry_s * entry = &writer->entries[writer->num_blocks++];
+	entry->offset = writer->offset;
+	entry->packed_size = packed_size;
+	entry->original_size = original_size;
+
+	if(writer->sink(writer->user, &block_header, sizeof(block_header)) != sizeof(block_header)) return BRC_EXIT_FAILURE;
+	if(writer->sink(writer->user, block, packed_size) != packed_size) return BRC_EXIT_FAILURE;
+	writer->offset += sizeof(block_header) + packed_size;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_writer_close(brc_writer_s * writer) {
+	brc_block_header_s end_marker = { 0, 0 };
+	brc_trailer_s trailer;
+	trailer.index_offset = writer->offset + sizeof(end_marker);
+	trailer.num_blocks = writer->num_blocks;
+	memcpy(trailer.magic, BRC_INDEX_MAGIC, sizeof(trailer.magic));
+
+	int err = BRC_EXIT_SUCCESS;
+	size_t index_size = writer->num_blocks * sizeof(brc_index_entry_s);
+	size_t checksums_size = writer->flags & BRC_FLAG_CHECKSUM ? writer->num_blocks * sizeof(uint32_t) : 0;
+	if(writer->sink(writer->user, &end_marker, sizeof(end_marker)) != sizeof(end_marker)
+		|| writer->sink(writer->user, writer->entries, index_size) != index_size
+		|| writer->sink(writer->user, writer->checksums, checksums_size) != checksums_size
+		|| writer->sink(writer->user, &trailer, sizeof(trailer)) != sizeof(trailer))
+		err = BRC_EXIT_FAILURE;
+	writer->offset += sizeof(end_marker) + index_size + checksums_size + sizeof(trailer);
+
+	free(writer->entries);
+	free(writer->checksums);
+	writer->entries = NULL;
+	writer->checksums = NULL;
+	writer->num_blocks = writer->capacity = 0;
+	return err;
+}
+
+/*** container reader ***/
+static int brc_check_header(brc_header_s * header) {
+	if(memcmp(header->magic, BRC_MAGIC, sizeof(BRC_MAGIC)) != 0)
+		return printf(" Input is not a BRC container! \n"), BRC_EXIT_FAILURE;
+	if(header->version != BRC_CONTAINER_VERSION)
+		return printf(" Unsupported BRC container version %i! \n", header->version), BRC_EXIT_FAILURE;
+	if(header->block_size == 0)
+		return printf(" Invalid container header! \n"), BRC_EXIT_FAILURE;
+	return BRC_EXIT_SUCCESS;
+}
+
+/* returns 0 for a valid block, 1 for the end marker, else -1 */
+static int brc_check_block_header(brc_header_s * header, brc_block_header_s * block_header) {
+	if(block_header->packed_size == 0 && block_header->original_size == 0)
+		return 1;
+	if(block_header->original_size > header->block_size || block_header->packed_size > brc_safe_memory_bound(header->block_size))
+		return printf(" Read invalid data!  \n"), BRC_EXIT_FAILURE;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_read_header(FILE * f, brc_header_s * header) {
+	if(fread(header, 1, sizeof(*header), f) != sizeof(*header))
+		return printf(" Input is not a BRC container! \n"), BRC_EXIT_FAILURE;
+	return brc_check_header(header);
+}
+
+int brc_read_block_header(FILE * f, brc_header_s * header, brc_block_header_s * block_header) {
+	if(fread(block_header, 1, sizeof(*block_header), f) != sizeof(*block_header))
+		return printf(" Unexpected end of input! \n"), BRC_EXIT_FAILURE;
+	return brc_check_block_header(header, block_header);
+}
+
+static int brc_check_index(brc_index_s * index, brc_trailer_s * trailer) {
+	index->num_blocks = trailer->num_blocks;
+	for(size_t i = 0; i < index->num_blocks; i++) {
+		brc_index_entry_s * entry = &index->entries[i];
+		/* bounded without sums that could wrap around for a crafted offset */
+		if(entry->original_size > index->header.block_size || entry->packed_size > brc_safe_memory_bound(index->header.block_size)
+			|| entry->offset < sizeof(brc_header_s) || entry->offset > trailer->index_offset
+			|| sizeof(brc_block_header_s) + entry->packed_size > trailer->index_offset - entry->offset) {
+			brc_free_index(index);
+			return printf(" Invalid block index! \n"), BRC_EXIT_FAILURE;
+		}
+		index->original_size += entry->original_size;
+	}
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_read_index(FILE * f, brc_index_s * index) {
+	brc_trailer_s trailer;
+	index->entries = NULL;
+	index->checksums = NULL;
+	index->num_blocks = 0;
+	index->original_size = 0;
+
+	if(brc_fseek(f, 0, SEEK_SET) != 0 || brc_read_header(f, &index->header) != BRC_EXIT_SUCCESS)
+		return BRC_EXIT_FAILURE;
+	if(brc_fseek(f, -(long)sizeof(trailer), SEEK_END) != 0)
+		return printf(" Missing block index! \n"), BRC_EXIT_FAILURE;
+	uint64_t trailer_offset = (uint64_t)brc_ftell(f);
+	if(fread(&trailer, 1, sizeof(trailer), f) != sizeof(trailer) || memcmp(trailer.magic, BRC_INDEX_MAGIC, sizeof(trailer.magic)) != 0)
+		return printf(" Missing block index! \n"), BRC_EXIT_FAILURE;
+	/* the index has to fit before the trailer, which also bounds the allocations below */
+	if(trailer.index_offset > trailer_offset || trailer.num_blocks > (trailer_offset - trailer.index_offset) / sizeof(brc_index_entry_s))
+		return printf(" Missing block index! \n"), BRC_EXIT_FAILURE;
+
+	index->entries = (brc_index_entry_s*)malloc((trailer.num_blocks + 1) * sizeof(brc_index_entry_s));
+	if(index->entries == NULL) return BRC_EXIT_FAILURE;
+	if(brc_fseek(f, trailer.index_offset, SEEK_SET) != 0 
+		|| fread(index->entries, sizeof(brc_index_entry_s), trailer.num_blocks, f) != trailer.num_blocks) {
+		brc_free_index(index);
+		return printf(" Missing block index! \n"), BRC_EXIT_FAILURE;
+	}
+	if(index->header.flags & BRC_FLAG_CHECKSUM) {
+		index->checksums = (uint32_t*)malloc((trailer.num_blocks + 1) * sizeof(uint32_t));
+		if(index->checksums == NULL || fread(index->checksums, sizeof(uint32_t), trailer.num_blocks, f) != trailer.num_blocks) {
+			brc_free_index(index);
+			return printf(" Missing block checksums! \n"), BRC_EXIT_FAILURE;
+		}
+	}
+	return brc_check_index(index, &trailer);
+}
+
+int brc_read_index_mem(unsigned char * data, size_t size, brc_index_s * index) {
+	brc_trailer_s trailer;
+	index->entries = NULL;
+	index->checksums = NULL;
+	index->num_blocks = 0;
+	index->original_size = 0;
+
+	if(size < sizeof(brc_header_s) + sizeof(trailer))
+		return printf(" Input is not a BRC container! \n"), BRC_EXIT_FAILURE;
+	memcpy(&index->header, data, sizeof(brc_header_s));
+	if(memcmp(index->header.magic, BRC_MAGIC, sizeof(BRC_MAGIC)) != 0 || index->header.version != BRC_CONTAINER_VERSION || index->header.block_size == 0)
+		return printf(" Input is not a BRC container! \n"), BRC_EXIT_FAILURE;
+
+	memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+	if(memcmp(trailer.magic, BRC_INDEX_MAGIC, sizeof(trailer.magic)) != 0 || trailer.index_offset > size - sizeof(trailer)
+		|| trailer.num_blocks > (size - sizeof(trailer) - trailer.index_offset) / sizeof(brc_index_entry_s))
+		return printf(" Missing block index! \n"), BRC_EXIT_FAILURE;
+
+	index->entries = (brc_index_entry_s*)malloc((trailer.num_blocks + 1) * sizeof(brc_index_entry_s));
+	if(index->entries == NULL) return BRC_EXIT_FAILURE;
+	memcpy(index->entries, data + trailer.index_offset, trailer.num_blocks * sizeof(brc_index_entry_s));
+	if(index->header.flags & BRC_FLAG_CHECKSUM) {
+		size_t index_end = trailer.index_offset + trailer.num_blocks * sizeof(brc_index_entry_s);
+		if(trailer.num_blocks > (size - sizeof(trailer) - index_end) / sizeof(uint32_t)) {
+			brc_free_index(index);
+			return printf(" Missing block checksums! \n"), BRC_EXIT_FAILURE;
+		}
+		index->checksums = (uint32_t*)malloc((trailer.num_blocks + 1) * sizeof(uint32_t));
+		if(index->checksums == NULL) return brc_free_index(index), BRC_EXIT_FAILURE;
+		memcpy(index->checksums, data + index_end, trailer.num_blocks * sizeof(uint32_t));
+	}
+	return brc_check_index(index, &trailer);
+}
+
+void brc_free_index(brc_index_s * index) {
+	free(index->entries);
+	free(index->checksums);
+	index->entries = NULL;
+	index->checksums = NULL;
+	index->num_blocks = 0;
+}
+
+/*** streaming ***/
+int brc_stream_encoder_init(brc_stream_encoder_s * enc, brc_sink_fn sink, void * user, size_t block_size, uint16_t flags) {
+	if(block_size == 0) return BRC_EXIT_FAILURE;
+	enc->fill = 0;
+	enc->block_size = block_size;
+	enc->writer.entries = NULL;
+	enc->writer.checksums = NULL;
+	if(brc_init_cxt(&enc->cxt, block_size) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+	enc->cxt.entropy = (flags & BRC_FLAG_ENTROPY) != 0;
+	enc->cxt.bwt = (flags & BRC_FLAG_BWT) != 0;
+	enc->buffer = (unsigned char*)malloc(block_size);
+	if(enc->buffer == NULL || brc_writer_open(&enc->writer, sink, user, block_size, flags) == BRC_EXIT_FAILURE)
+		return brc_stream_encoder_free(enc), BRC_EXIT_FAILURE;
+	return BRC_EXIT_SUCCESS;
+}
+
+static int brc_stream_encode_block(brc_stream_encoder_s * enc, unsigned char * src, size_t size) {
+	uint32_t checksum = enc->writer.flags & BRC_FLAG_CHECKSUM ? brc_checksum(src, size) : 0;
+	if(brc_encode(&enc->cxt, src, size) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+	return brc_writer_add_block(&enc->writer, enc->cxt.block, enc->cxt.size, size, checksum);
+}
+
+/* whole blocks are encoded straight from 'data', only a partial block is copied aside until the rest arrives */
+int brc_stream_encode(brc_stream_encoder_s * enc, unsigned char * data, size_t size) {
+	while(size > 0) {
+		if(enc->fill == 0 && size >= enc->block_size) {
+			if(brc_stream_encode_block(enc, data, enc->block_size) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+			data += enc->block_size;
+			size -= enc->block_size;
+			continue;
+		}
+		size_t n = enc->block_size - enc->fill < size ? enc->block_size - enc->fill : size;
+		memcpy(enc->buffer + enc->fill, data, n);
+		enc->fill += n;
+		data += n;
+		size -= n;
+		if(enc->fill == enc->block_size) {
+			enc->fill = 0;
+			if(brc_stream_encode_block(enc, enc->buffer, enc->block_size) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+		}
+	}
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_stream_encoder_flush(brc_stream_encoder_s * enc) {
+	if(enc->fill == 0) return BRC_EXIT_SUCCESS;
+	size_t size = enc->fill;
+	enc->fill = 0;
+	return brc_stream_encode_block(enc, enc->buffer, size);
+}
+
+int brc_stream_encoder_finish(brc_stream_encoder_s * enc) {
+	int err = brc_stream_encoder_flush(enc);
+	if(brc_writer_close(&enc->writer) == BRC_EXIT_FAILURE) err = BRC_EXIT_FAILURE;
+	brc_stream_encoder_free(enc);
+	return err;
+}
+
+void brc_stream_encoder_free(brc_stream_encoder_s * enc) {
+	if(enc->cxt.block) brc_free_cxt(&enc->cxt);
+	free(enc->buffer);
+	free(enc->writer.entries);
+	free(enc->writer.checksums);
+	enc->buffer = NULL;
+	enc->writer.entries = NULL;
+	enc->writer.checksums = NULL;
+}
+
+/* the decoder collects each header and packed block in turn, 'need' bytes into 'target' */
+enum { BRC_STREAM_HEADER, BRC_STREAM_BLOCK_HEADER, BRC_STREAM_BLOCK, BRC_STREAM_END, BRC_STREAM_FAILED };
+
+static void brc_stream_expect(brc_stream_decoder_s * dec, int state, void * target, size_t need) {
+	dec->state = state;
+	dec->target = (unsigned char*)target;
+	dec->need = need;
+	dec->fill = 0;
+}
+
+int brc_stream_decoder_init(brc_stream_decoder_s * dec, brc_sink_fn sink, void * user) {
+	dec->sink = sink;
+	dec->user = user;
+	dec->cxt.block = NULL;
+	dec->shared = NULL;
+	dec->buffer = NULL;
+	brc_stream_expect(dec, BRC_STREAM_HEADER, &dec->header, sizeof(dec->header));
+	return BRC_EXIT_SUCCESS;
+}
+
+static int brc_stream_decode_block(brc_stream_decoder_s * dec, unsigned char * src) {
+	size_t original_size;
+	if(brc_decode_from(&dec->cxt, src, dec->block_header.packed_size, dec->buffer, dec->header.block_size, &original_size) == BRC_EXIT_FAILURE 
+		|| original_size != dec->block_header.original_size)
+		return printf(" Failed to decode input!  \n"), BRC_EXIT_FAILURE;
+	if(dec->sink(dec->user, dec->buffer, original_size) != original_size) return BRC_EXIT_FAILURE;
+	brc_stream_expect(dec, BRC_STREAM_BLOCK_HEADER, &dec->block_header, sizeof(dec->block_header));
+	return BRC_EXIT_SUCCESS;
+}
+
+/* a header or block completed in 'target', moves on to the next one */
+static int brc_stream_advance(brc_stream_decoder_s * dec) {
+	switch(dec->state) {
+		case BRC_STREAM_HEADER: {
+			if(brc_check_header(&dec->header) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+			if(brc_init_cxt(&dec->cxt, dec->header.block_size) == BRC_EXIT_FAILURE) 
+				return dec->cxt.block = NULL, printf(" Failed to allocate brc cxt!  \n"), BRC_EXIT_FAILURE;
+			dec->cxt.shared = dec->shared;
+			if((dec->buffer = (unsigned char*)malloc(dec->header.block_size)) == NULL) 
+				return printf(" Failed to allocate output!  \n"), BRC_EXIT_FAILURE;
+			brc_stream_expect(dec, BRC_STREAM_BLOCK_HEADER, &dec->block_header, sizeof(dec->block_header));
+		} break;
+		case BRC_STREAM_BLOCK_HEADER: {
+			int status = brc_check_block_header(&dec->header, &dec->block_header);
+			if(status == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+			if(status == 1) brc_stream_expect(dec, BRC_STREAM_END, NULL, 0);
+			else brc_stream_expect(dec, BRC_STREAM_BLOCK, dec->cxt.block, dec->block_header.packed_size);
+		} break;
+		case BRC_STREAM_BLOCK: return brc_stream_decode_block(dec, dec->cxt.block);
+	}
+	return BRC_EXIT_SUCCESS;
+}
+
+/* packed blocks lying whole in 'data' are decoded in place, only blocks split across calls are gathered first */
+int brc_stream_decode(brc_stream_decoder_s * dec, unsigned char * data, size_t size) {
+	if(dec->state == BRC_STREAM_FAILED) return BRC_EXIT_FAILURE;
+	while(size > 0 && dec->state != BRC_STREAM_END) {
+		if(dec->state == BRC_STREAM_BLOCK && dec->fill == 0 && size >= dec->need) {
+			size_t packed_size = dec->need;
+			if(brc_stream_decode_block(dec, data) == BRC_EXIT_FAILURE) 
+				return dec->state = BRC_STREAM_FAILED, BRC_EXIT_FAILURE;
+			data += packed_size;
+			size -= packed_size;
+			continue;
+		}
+		size_t n = dec->need - dec->fill < size ? dec->need - dec->fill : size;
+		memcpy(dec->target + dec->fill, data, n);
+		dec->fill += n;
+		data += n;
+		size -= n;
+		if(dec->fill == dec->need && brc_stream_advance(dec) == BRC_EXIT_FAILURE) 
+			return dec->state = BRC_STREAM_FAILED, BRC_EXIT_FAILURE;
+	}
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_stream_decoder_finish(brc_stream_decoder_s * dec) {
+	int err = BRC_EXIT_SUCCESS;
+	if(dec->state != BRC_STREAM_END) {
+		if(dec->state != BRC_STREAM_FAILED) printf(" Unexpected end of input! \n");
+		err = BRC_EXIT_FAILURE;
+	}
+	brc_stream_decoder_free(dec);
+	return err;
+}
+
+void brc_stream_decoder_free(brc_stream_decoder_s * dec) {
+	if(dec->cxt.block) brc_free_cxt(&dec->cxt);
+	free(dec->buffer);
+	dec->buffer = NULL;
+}
+
+/*** random access decoding ***/
+/* checks the 'n' blocks decoded from block 'b' on against their sizes and checksums, reporting the first bad one */
+static bool brc_check_blocks(brc_index_s * index, size_t b, brc_job_s * jobs, size_t n, bool decoded) {
+	/* interleaved blocks fail together */
+	if(!decoded && n > 1)
+		return printf(" One of blocks %llu to %llu is corrupt! \n", (long long)b, (long long)(b + n - 1)), false;
+	for(size_t j = 0; j < n; j++) {
+		bool ok = decoded && jobs[j].dst_size == index->entries[b + j].original_size
+			&& (index->checksums == NULL || brc_checksum(jobs[j].dst, jobs[j].dst_size) == index->checksums[b + j]);
+		if(!ok) return printf(" Block %llu is corrupt! \n", (long long)(b + j)), false;
+	}
+	return true;
+}
+
+int brc_decode_range(FILE * f_input, brc_index_s * index, uint64_t begin, uint64_t end, FILE * f_output, int num_threads, int interleave) {
+	if(end > index->original_size) end = index->original_size;
+	if(begin >= end) return BRC_EXIT_SUCCESS;
+
+	/* blocks [first, last) cover the range, 'first_start' is the original offset of the first one */
+	size_t first = 0, last;
+	uint64_t first_start = 0;
+	while(first_start + index->entries[first].original_size <= begin)
+		first_start += index->entries[first++].original_size;
+	uint64_t last_end = first_start;
+	for(last = first; last < index->num_blocks && last_end < end; last++)
+		last_end += index->entries[last].original_size;
+
+	/* each thread decodes groups of 'interleave' consecutive blocks together */
+	if(interleave < 1) interleave = 1;
+	if(interleave > BRC_MAX_INTERLEAVE) interleave = BRC_MAX_INTERLEAVE;
+	size_t groups = (last - first + interleave - 1) / interleave;
+	if(num_threads < 1) num_threads = 1;
+	if((size_t)num_threads > groups) num_threads = groups;
+
+	size_t block_size = index->header.block_size, num_cxts = num_threads * interleave;
+	brc_cxt_s * brc_cxt = (brc_cxt_s*)calloc(num_cxts, sizeof(brc_cxt_s));
+	unsigned char ** buffer = (unsigned char**)calloc(num_cxts, sizeof(unsigned char*));
+	int err = brc_cxt == NULL || buffer == NULL ? BRC_EXIT_FAILURE : BRC_EXIT_SUCCESS;
+	for(size_t t = 0; t < num_cxts && err == BRC_EXIT_SUCCESS; t++) {
+		if(brc_init_cxt(&brc_cxt[t], block_size) == BRC_EXIT_FAILURE) err = BRC_EXIT_FAILURE;
+		else if((buffer[t] = (unsigned char*)malloc(block_size)) == NULL) err = BRC_EXIT_FAILURE;
+		else brc_cxt[t].interleave = interleave;
+	}
+
+	/* blocks are read under a lock, decoded in any order and written back in order */
+	if(err == BRC_EXIT_SUCCESS) {
+		uint64_t block_start = first_start;
+		#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(num_threads)
+		for(long g = 0; g < (long)groups; g++) {
+			size_t t = omp_get_thread_num() * interleave, b = first + g * interleave;
+			size_t n = last - b < (size_t)interleave ? last - b : interleave;
+			brc_job_s jobs[BRC_MAX_INTERLEAVE];
+			bool ok = true;
+
+			#pragma omp critical(brc_decode_range_read)
+			{
+				for(size_t j = 0; j < n && ok; j++) {
+					brc_index_entry_s * entry = &index->entries[b + j];
+					ok = brc_fseek(f_input, entry->offset + sizeof(brc_block_header_s), SEEK_SET) == 0
+						&& fread(brc_cxt[t + j].block, 1, entry->packed_size, f_input) == entry->packed_size;
+				}
+			}
+
+			for(size_t j = 0; j < n; j++) {
+				jobs[j].src = brc_cxt[t + j].block;
+				jobs[j].src_size = index->entries[b + j].packed_size;
+				jobs[j].dst = buffer[t + j];
+				jobs[j].dst_capacity = block_size;
+				jobs[j].dst_size = 0;
+			}
+			if(ok) ok = brc_check_blocks(index, b, jobs, n, brc_decode_interleaved(&brc_cxt[t], jobs, n) == BRC_EXIT_SUCCESS);
+
+			#pragma omp ordered
+			{
+				if(!ok) err = BRC_EXIT_FAILURE;
+				for(size_t j = 0; j < n; j++) {
+					if(err == BRC_EXIT_SUCCESS) {
+						size_t original_size = jobs[j].dst_size;
+						uint64_t lo = begin > block_start ? begin - block_start : 0;
+						uint64_t hi = end < block_start + original_size ? end - block_start : original_size;
+						if(fwrite(buffer[t + j] + lo, 1, hi - lo, f_output) != hi - lo) err = BRC_EXIT_FAILURE;
+					}
+					block_start += index->entries[b + j].original_size;
+				}
+			}
+		}
+	}
+
+	for(size_t t = 0; t < num_cxts; t++) {
+		if(brc_cxt && brc_cxt[t].block) brc_free_cxt(&brc_cxt[t]);
+		if(buffer) free(buffer[t]);
+	}
+	free(brc_cxt);
+	free(buffer);
+	return err;
+}
+
+int brc_decode_mem(unsigned char * src, brc_index_s * index, unsigned char * dst, int num_threads, int interleave) {
+	if(index->num_blocks == 0) return BRC_EXIT_SUCCESS;
+	if(interleave < 1) interleave = 1;
+	if(interleave > BRC_MAX_INTERLEAVE) interleave = BRC_MAX_INTERLEAVE;
+	size_t groups = (index->num_blocks + interleave - 1) / interleave;
+	if(num_threads < 1) num_threads = 1;
+	if((size_t)num_threads > groups) num_threads = groups;
+
+	/* every block knows where its output starts, so they decode in any order with no copies */
+	size_t num_cxts = num_threads * interleave;
+	uint64_t * starts = (uint64_t*)malloc(index->num_blocks * sizeof(uint64_t));
+	brc_cxt_s * brc_cxt = (brc_cxt_s*)calloc(num_cxts, sizeof(brc_cxt_s));
+	unsigned char ** scratch = (unsigned char**)calloc(num_cxts, sizeof(unsigned char*));
+	int err = starts == NULL || brc_cxt == NULL || scratch == NULL ? BRC_EXIT_FAILURE : BRC_EXIT_SUCCESS;
+	for(size_t t = 0; t < num_cxts && err == BRC_EXIT_SUCCESS; t++) {
+		if(brc_init_cxt(&brc_cxt[t], index->header.block_size) == BRC_EXIT_FAILURE) err = BRC_EXIT_FAILURE;
+		else if(dst == NULL && (scratch[t] = (unsigned char*)malloc(index->header.block_size)) == NULL) err = BRC_EXIT_FAILURE;
+		else brc_cxt[t].interleave = interleave;
+	}
+
+	if(err == BRC_EXIT_SUCCESS) {
+		for(size_t b = 0, start = 0; b < index->num_blocks; b++) {
+			starts[b] = start;
+			start += index->entries[b].original_size;
+		}
+
+		#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+		for(long g = 0; g < (long)groups; g++) {
+			size_t t = omp_get_thread_num() * interleave, b = g * interleave;
+			size_t n = index->num_blocks - b < (size_t)interleave ? index->num_blocks - b : interleave;
+			brc_job_s jobs[BRC_MAX_INTERLEAVE];
+			for(size_t j = 0; j < n; j++) {
+				brc_index_entry_s * entry = &index->entries[b + j];
+				jobs[j].src = src + entry->offset + sizeof(brc_block_header_s);
+				jobs[j].src_size = entry->packed_size;
+				jobs[j].dst = dst ? dst + starts[b + j] : scratch[t + j];
+				jobs[j].dst_capacity = entry->original_size;
+			}
+			if(!brc_check_blocks(index, b, jobs, n, brc_decode_interleaved(&brc_cxt[t], jobs, n) == BRC_EXIT_SUCCESS)) {
+				#pragma omp atomic write
+				err = BRC_EXIT_FAILURE;
+			}
+		}
+	}
+
+	for(size_t t = 0; t < num_cxts; t++) {
+		if(brc_cxt && brc_cxt[t].block) brc_free_cxt(&brc_cxt[t]);
+		if(scratch) free(scratch[t]);
+	}
+	free(brc_cxt);
+	free(scratch);
+	free(starts);
+	return err;
+}
+
+/*** memory mapped files ***/
+#ifdef _WIN32
+int brc_mmap_open(brc_mmap_s * map, const char * path) {
+	LARGE_INTEGER size;
+	map->data = NULL;
+	map->mapping = NULL;
+	map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(map->file == INVALID_HANDLE_VALUE) return BRC_EXIT_FAILURE;
+	if(!GetFileSizeEx(map->file, &size)) return CloseHandle(map->file), BRC_EXIT_FAILURE;
+	map->size = (size_t)size.QuadPart;
+	if(map->size == 0) return BRC_EXIT_SUCCESS;
+	map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(map->mapping == NULL) return CloseHandle(map->file), BRC_EXIT_FAILURE;
+	map->data = (unsigned char*)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+	if(map->data == NULL) return CloseHandle(map->mapping), CloseHandle(map->file), BRC_EXIT_FAILURE;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_mmap_create(brc_mmap_s * map, const char * path, size_t size) {
+	LARGE_INTEGER end;
+	end.QuadPart = size;
+	map->data = NULL;
+	map->mapping = NULL;
+	map->size = size;
+	map->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(map->file == INVALID_HANDLE_VALUE) return BRC_EXIT_FAILURE;
+	if(size == 0) return BRC_EXIT_SUCCESS;
+	if(!SetFilePointerEx(map->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(map->file)) 
+		return CloseHandle(map->file), BRC_EXIT_FAILURE;
+	map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+	if(map->mapping == NULL) return CloseHandle(map->file), BRC_EXIT_FAILURE;
+	map->data = (unsigned char*)MapViewOfFile(map->mapping, FILE_MAP_WRITE, 0, 0, 0);
+	if(map->data == NULL) return CloseHandle(map->mapping), CloseHandle(map->file), BRC_EXIT_FAILURE;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_mmap_close(brc_mmap_s * map, size_t final_size) {
+	int err = BRC_EXIT_SUCCESS;
+	if(map->data) UnmapViewOfFile(map->data);
+	if(map->mapping) CloseHandle(map->mapping);
+	if(final_size < map->size) {
+		LARGE_INTEGER end;
+		end.QuadPart = final_size;
+		if(!SetFilePointerEx(map->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(map->file)) err = BRC_EXIT_FAILURE;
+	}
+	CloseHandle(map->file);
+	map->data = NULL;
+	return err;
+}
+#else
+int brc_mmap_open(brc_mmap_s * map, const char * path) {
+	struct stat st;
+	map->data = NULL;
+	map->fd = open(path, O_RDONLY);
+	if(map->fd < 0) return BRC_EXIT_FAILURE;
+	if(fstat(map->fd, &st) != 0) return close(map->fd), BRC_EXIT_FAILURE;
+	map->size = st.st_size;
+	if(map->size == 0) return BRC_EXIT_SUCCESS;
+	void * data = mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+	if(data == MAP_FAILED) return close(map->fd), BRC_EXIT_FAILURE;
+	madvise(data, map->size, MADV_SEQUENTIAL);
+	map->data = (unsigned char*)data;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_mmap_create(brc_mmap_s * map, const char * path, size_t size) {
+	map->data = NULL;
+	map->size = size;
+	map->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(map->fd < 0) return BRC_EXIT_FAILURE;
+	if(size == 0) return BRC_EXIT_SUCCESS;
+	/* reserve the blocks up front where the file system allows it, a sparse file otherwise */
+	if(posix_fallocate(map->fd, 0, size) != 0 && ftruncate(map->fd, size) != 0)
+		return close(map->fd), BRC_EXIT_FAILURE;
+	void * data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+	if(data == MAP_FAILED) return close(map->fd), BRC_EXIT_FAILURE;
+	madvise(data, size, MADV_SEQUENTIAL);
+	map->data = (unsigned char*)data;
+	return BRC_EXIT_SUCCESS;
+}
+
+int brc_mmap_close(brc_mmap_s * map, size_t final_size) {
+	int err = BRC_EXIT_SUCCESS;
+	if(map->data) munmap(map->data, map->size);
+	if(final_size < map->size && ftruncate(map->fd, final_size) != 0) err = BRC_EXIT_FAILURE;
+	close(map->fd);
+	map->data = NULL;
+	return err;
+}
+#endif
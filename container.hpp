@@ -0,0 +1,200 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "brc.hpp"
+
+/*
+	BRC container, integers are stored in host byte order (little endian on x86):
+		header       : "BRC\0", uint16 version, uint16 flags, uint64 block size
+		blocks       : uint64 packed size, uint64 original size, packed BRC block
+		end marker   : a block header with both sizes set to 0
+		index        : one entry per block (offset of its block header, packed size, original size)
+		checksums    : with BRC_FLAG_CHECKSUM, one uint32 per block, the brc_checksum of its original bytes
+		trailer      : uint64 index offset, uint64 number of blocks, "BRCINDEX"
+	The index lets readers find any block without walking the ones before it. The checksums sit between
+	the index and the trailer, where readers that do not know the flag never look.
+*/
+#define BRC_CONTAINER_VERSION 1
+#define BRC_MAGIC "BRC"
+#define BRC_INDEX_MAGIC "BRCINDEX"
+
+/* header flags, informational since every block records how it was coded */
+#define BRC_FLAG_ENTROPY (1 << 0) /* blocks were written with the rANS stage enabled */
+#define BRC_FLAG_BWT (1 << 1) /* blocks were BWT transformed by BRC itself, so the output is raw data */
+#define BRC_FLAG_CHECKSUM (1 << 2) /* the index is followed by a checksum of every block */
+
+struct brc_header_s {
+	char magic[4];
+	uint16_t version;
+	uint16_t flags;
+	uint64_t block_size;
+};
+
+struct brc_block_header_s {
+	uint64_t packed_size;
+	uint64_t original_size;
+};
+
+struct brc_index_entry_s {
+	uint64_t offset;
+	uint64_t packed_size;
+	uint64_t original_size;
+};
+
+struct brc_trailer_s {
+	uint64_t index_offset;
+	uint64_t num_blocks;
+	char magic[8];
+};
+
+struct brc_index_s {
+	brc_header_s header;
+	brc_index_entry_s * entries;
+	size_t num_blocks;
+	uint64_t original_size; /* sum of all block sizes */
+	uint32_t * checksums; /* one per block, NULL unless the container has BRC_FLAG_CHECKSUM */
+};
+
+/* output callback of the writer, returns the number of bytes it consumed */
+typedef size_t (*brc_sink_fn)(void * user, const void * data, size_t size);
+
+/* sink for a FILE*, passed as 'user' */
+size_t brc_file_sink(void * user, const void * data, size_t size);
+
+/* sink appending to a fixed buffer, pass a brc_mem_sink_s as 'user' */
+struct brc_mem_sink_s {
+	unsigned char * data;
+	size_t size;
+	size_t capacity;
+};
+size_t brc_mem_sink(void * user, const void * data, size_t size);
+
+struct brc_writer_s {
+	brc_sink_fn sink;
+	void * user;
+	uint64_t offset; /* bytes written so far */
+	brc_index_entry_s * entries;
+	uint32_t * checksums; /* kept with BRC_FLAG_CHECKSUM */
+	size_t num_blocks;
+	size_t capacity;
+	uint16_t flags;
+};
+
+/* largest container holding 'size' bytes split into blocks of 'block_size' */
+size_t brc_container_bound(size_t size, size_t block_size);
+
+/* writes the container header through 'sink'; returns 0 on success, else -1 */
+int brc_writer_open(brc_writer_s * writer, brc_sink_fn sink, void * user, size_t block_size, uint16_t flags);
+
+/* appends one packed block and records it in the index; 'checksum' is the brc_checksum of its original bytes, ignored without BRC_FLAG_CHECKSUM */
+int brc_writer_add_block(brc_writer_s * writer, unsigned char * block, size_t packed_size, size_t original_size, uint32_t checksum);
+
+/* writes the end marker, index and trailer then frees the writer */
+int brc_writer_close(brc_writer_s * writer);
+
+/* reads and validates the container header at the current position of 'f' */
+int brc_read_header(FILE * f, brc_header_s * header);
+
+/* reads the next block header; returns 0 on success, 1 at the end marker, else -1 */
+int brc_read_block_header(FILE * f, brc_header_s * header, brc_block_header_s * block_header);
+
+/* loads header and block index from a seekable container */
+int brc_read_index(FILE * f, brc_index_s * index);
+
+void brc_free_index(brc_index_s * index);
+
+/* same as brc_read_index for a container held in memory */
+int brc_read_index_mem(unsigned char * data, size_t size, brc_index_s * index);
+
+/*
+	decodes every block of the in-memory container 'src' straight into 'dst', which must hold index->original_size
+	bytes; blocks run on 'num_threads' threads, 'interleave' at a time on each. With 'dst' NULL every thread decodes
+	into a scratch block and nothing is kept, which verifies the container. Blocks are checked against their
+	checksums when the container has them.
+*/
+int brc_decode_mem(unsigned char * src, brc_index_s * index, unsigned char * dst, int num_threads, int interleave);
+
+/* decodes the original bytes [begin, end) into 'f_output', only the blocks covering the range are read and checked against their checksums; blocks are decoded on 'num_threads' threads, 'interleave' at a time on each */
+int brc_decode_range(FILE * f_input, brc_index_s * index, uint64_t begin, uint64_t end, FILE * f_output, int num_threads, int interleave);
+
+/*** streaming ***/
+/*
+	Incremental coding for callers that see their data in pieces. The encoder takes input of any size,
+	fills blocks of 'block_size' and emits the container through its sink as each one completes; the
+	decoder takes a container in pieces of any size and passes the original bytes to its sink a block at
+	a time. Either side holds one block's worth of buffers, whatever the length of the stream.
+*/
+struct brc_stream_encoder_s {
+	brc_cxt_s cxt; /* set cxt.segments or cxt.shared after init to use them */
+	brc_writer_s writer;
+	unsigned char * buffer; /* partial block waiting for more input */
+	size_t fill;
+	size_t block_size;
+};
+
+struct brc_stream_decoder_s {
+	brc_cxt_s cxt; /* set up once the container header arrives */
+	brc_shared_s * shared; /* set after init to the table the stream was encoded with, NULL by default */
+	brc_header_s header;
+	brc_block_header_s block_header;
+	unsigned char * buffer; /* decoded block */
+	unsigned char * target; /* where the part being collected goes */
+	size_t need, fill;
+	int state;
+	brc_sink_fn sink;
+	void * user;
+};
+
+/* writes the container header through 'sink'; BRC_FLAG_ENTROPY and BRC_FLAG_BWT in 'flags' switch those stages on; returns 0 on success, else -1 */
+int brc_stream_encoder_init(brc_stream_encoder_s * enc, brc_sink_fn sink, void * user, size_t block_size, uint16_t flags);
+
+/* consumes all of 'data', writing out every block it completes */
+int brc_stream_encode(brc_stream_encoder_s * enc, unsigned char * data, size_t size);
+
+/* writes out the buffered input as a short block, so everything passed so far can be decoded */
+int brc_stream_encoder_flush(brc_stream_encoder_s * enc);
+
+/* flushes, writes the end marker, index and trailer, then frees the encoder */
+int brc_stream_encoder_finish(brc_stream_encoder_s * enc);
+
+/* frees the encoder without finishing the container */
+void brc_stream_encoder_free(brc_stream_encoder_s * enc);
+
+int brc_stream_decoder_init(brc_stream_decoder_s * dec, brc_sink_fn sink, void * user);
+
+/* consumes all of 'data', passing every block it completes to the sink; anything after the end marker is ignored */
+int brc_stream_decode(brc_stream_decoder_s * dec, unsigned char * data, size_t size);
+
+/* frees the decoder; returns 0 if the stream reached its end marker, else -1 */
+int brc_stream_decoder_finish(brc_stream_decoder_s * dec);
+
+/* frees the decoder wherever it is in the stream */
+void brc_stream_decoder_free(brc_stream_decoder_s * dec);
+
+/*** memory mapped files ***/
+struct brc_mmap_s {
+	unsigned char * data;
+	size_t size;
+#ifdef _WIN32
+	void * file;
+	void * mapping;
+#else
+	int fd;
+#endif
+};
+
+/* maps an existing file read only and hints sequential access */
+int brc_mmap_open(brc_mmap_s * map, const char * path);
+
+/* creates or truncates 'path', preallocates 'size' bytes and maps them writable */
+int brc_mmap_create(brc_mmap_s * map, const char * path, size_t size);
+
+/* unmaps the file; writable maps are cut down to 'final_size' bytes */
+int brc_mmap_close(brc_mmap_s * map, size_t final_size);
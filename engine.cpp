@@ -0,0 +1,266 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "engine.hpp"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct brc_batch_s {
+	brc_job_s * jobs;
+	bool decoding;
+	brc_batch_options_s options;
+	size_t remaining; /* jobs not finished yet, under 'lock' */
+	int failed;
+	std::mutex lock;
+	std::condition_variable done;
+};
+
+struct brc_task_s {
+	brc_batch_s * batch;
+	size_t job;
+};
+
+struct brc_worker_s {
+	std::mutex lock;
+	std::deque<brc_task_s> tasks;
+	brc_cxt_s cxts[BRC_MAX_INTERLEAVE]; /* all but the first stay empty unless batches interleave */
+	std::thread thread;
+};
+
+struct brc_engine_s {
+	brc_worker_s * workers;
+	int num_workers;
+	int flags;
+	brc_allocator_s * pool; /* every context's buffers, reused by workers on the same node */
+	std::mutex lock;
+	std::condition_variable wake;
+	std::atomic<size_t> queued; /* tasks on all queues, workers sleep while it is 0 */
+	size_t next_queue; /* where the next batch starts dealing its tasks */
+	bool stop;
+};
+
+static void brc_pin_thread(int cpu) {
+	unsigned int cpus = std::thread::hardware_concurrency();
+	if(cpus == 0) return;
+	cpu %= cpus;
+#ifdef _WIN32
+	if(cpu < 64) SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+/* own queue from the front, then the others' from the back, starting with the next worker along */
+static bool brc_take_task(brc_engine_s * engine, int self, brc_task_s * task) {
+	for(int i = 0; i < engine->num_workers; i++) {
+		brc_worker_s * worker = &engine->workers[(self + i) % engine->num_workers];
+		std::lock_guard<std::mutex> guard(worker->lock);
+		if(worker->tasks.empty()) continue;
+		if(i == 0) {
+			*task = worker->tasks.front();
+			worker->tasks.pop_front();
+		} else {
+			*task = worker->tasks.back();
+			worker->tasks.pop_back();
+		}
+		engine->queued--;
+		return true;
+	}
+	return false;
+}
+
+/* more tasks of the same batch from the front of the worker's own queue, for decoding them together */
+static size_t brc_take_more(brc_engine_s * engine, int self, brc_task_s * tasks, size_t num_tasks, size_t max_tasks) {
+	brc_worker_s * worker = &engine->workers[self];
+	std::lock_guard<std::mutex> guard(worker->lock);
+	while(num_tasks < max_tasks && !worker->tasks.empty() && worker->tasks.front().batch == tasks[0].batch) {
+		tasks[num_tasks++] = worker->tasks.front();
+		worker->tasks.pop_front();
+		engine->queued--;
+	}
+	return num_tasks;
+}
+
+static void brc_set_options(brc_cxt_s * cxt, brc_batch_s * batch) {
+	cxt->segments = batch->options.segments > 1 ? batch->options.segments : 1;
+	cxt->interleave = batch->options.interleave > 1 ? batch->options.interleave : 1;
+	cxt->entropy = batch->options.entropy;
+	cxt->bwt = batch->options.bwt;
+	cxt->level = batch->options.level > 0 && batch->options.level < BRC_MAX_LEVEL ? batch->options.level : BRC_MAX_LEVEL;
+	cxt->shared = batch->options.shared;
+}
+
+static int brc_run_job(brc_cxt_s * cxt, brc_batch_s * batch, brc_job_s * job) {
+	brc_set_options(cxt, batch);
+	job->dst_size = 0;
+	if(batch->decoding) {
+		if(brc_resize_cxt(cxt, job->dst_capacity) == BRC_EXIT_FAILURE) return BRC_EXIT_FAILURE;
+		return brc_decode_from(cxt, job->src, job->src_size, job->dst, job->dst_capacity, &job->dst_size);
+	}
+	if(brc_encode(cxt, job->src, job->src_size) == BRC_EXIT_FAILURE || cxt->size > job->dst_capacity) return BRC_EXIT_FAILURE;
+	memcpy(job->dst, cxt->block, cxt->size);
+	job->dst_size = cxt->size;
+	return BRC_EXIT_SUCCESS;
+}
+
+/* decodes the jobs of 'tasks' together, one context each */
+static void brc_run_interleaved(brc_cxt_s * cxts, brc_task_s * tasks, size_t num_tasks) {
+	brc_batch_s * batch = tasks[0].batch;
+	brc_job_s jobs[BRC_MAX_INTERLEAVE];
+	bool ready = true;
+	for(size_t i = 0; i < num_tasks; i++) {
+		jobs[i] = batch->jobs[tasks[i].job];
+		brc_set_options(&cxts[i], batch);
+		if(brc_resize_cxt(&cxts[i], jobs[i].dst_capacity) == BRC_EXIT_FAILURE) ready = false;
+	}
+	if(ready) brc_decode_interleaved(cxts, jobs, num_tasks);
+	for(size_t i = 0; i < num_tasks; i++) {
+		brc_job_s * job = &batch->jobs[tasks[i].job];
+		job->dst_size = ready ? jobs[i].dst_size : 0;
+		job->status = ready ? jobs[i].status : BRC_EXIT_FAILURE;
+	}
+}
+
+static void brc_worker_main(brc_engine_s * engine, int self) {
+	if(engine->flags & BRC_ENGINE_PIN) brc_pin_thread(self);
+	brc_cxt_s * cxts = engine->workers[self].cxts;
+	while(1) {
+		brc_task_s tasks[BRC_MAX_INTERLEAVE];
+		if(!brc_take_task(engine, self, &tasks[0])) {
+			std::unique_lock<std::mutex> guard(engine->lock);
+			engine->wake.wait(guard, [&]{ return engine->queued > 0 || engine->stop; });
+			if(engine->queued == 0) return;
+			continue;
+		}
+
+		brc_batch_s * batch = tasks[0].batch;
+		size_t num_tasks = 1, interleave = batch->options.interleave > 1 ? batch->options.interleave : 1;
+		if(batch->decoding && interleave > 1)
+			num_tasks = brc_take_more(engine, self, tasks, 1, interleave < BRC_MAX_INTERLEAVE ? interleave : BRC_MAX_INTERLEAVE);
+		if(num_tasks > 1) 
+			brc_run_interleaved(cxts, tasks, num_tasks);
+		else 
+			batch->jobs[tasks[0].job].status = brc_run_job(&cxts[0], batch, &batch->jobs[tasks[0].job]);
+
+		/* the submitter may return as soon as the lock is released, the batch lives on its stack */
+		std::lock_guard<std::mutex> guard(batch->lock);
+		for(size_t i = 0; i < num_tasks; i++)
+			if(batch->jobs[tasks[i].job].status == BRC_EXIT_FAILURE) batch->failed = 1;
+		batch->remaining -= num_tasks;
+		if(batch->remaining == 0) batch->done.notify_all();
+	}
+}
+
+brc_engine_s * brc_engine_create(int num_threads, int flags) {
+	if(num_threads < 1) num_threads = std::thread::hardware_concurrency();
+	if(num_threads < 1) num_threads = 1;
+	brc_engine_s * engine = new brc_engine_s;
+	engine->workers = new brc_worker_s[num_threads];
+	engine->num_workers = num_threads;
+	engine->flags = flags;
+	engine->queued = 0;
+	engine->next_queue = 0;
+	engine->stop = false;
+	int pages = (flags & BRC_ENGINE_HUGE_PAGES) ? BRC_PAGES_HUGE : (flags & BRC_ENGINE_THP) ? BRC_PAGES_THP : BRC_PAGES_SMALL;
+	engine->pool = brc_pool_create(brc_page_allocator(pages));
+
+	/* contexts start empty and grow to the largest block their worker meets, on the worker's thread and so on its node */
+	for(int c = 0; c < num_threads * BRC_MAX_INTERLEAVE; c++) {
+		if(brc_init_cxt_with(&engine->workers[c / BRC_MAX_INTERLEAVE].cxts[c % BRC_MAX_INTERLEAVE], 0, engine->pool) == BRC_EXIT_FAILURE) {
+			while(c--) brc_free_cxt(&engine->workers[c / BRC_MAX_INTERLEAVE].cxts[c % BRC_MAX_INTERLEAVE]);
+			brc_pool_destroy(engine->pool);
+			delete[] engine->workers;
+			delete engine;
+			return NULL;
+		}
+	}
+	for(int t = 0; t < num_threads; t++)
+		engine->workers[t].thread = std::thread(brc_worker_main, engine, t);
+	return engine;
+}
+
+void brc_engine_destroy(brc_engine_s * engine) {
+	{
+		std::lock_guard<std::mutex> guard(engine->lock);
+		engine->stop = true;
+		engine->wake.notify_all();
+	}
+	for(int t = 0; t < engine->num_workers; t++) {
+		engine->workers[t].thread.join();
+		for(int c = 0; c < BRC_MAX_INTERLEAVE; c++)
+			brc_free_cxt(&engine->workers[t].cxts[c]);
+	}
+	brc_pool_destroy(engine->pool);
+	delete[] engine->workers;
+	delete engine;
+}
+
+int brc_engine_threads(brc_engine_s * engine) {
+	return engine->num_workers;
+}
+
+/* gives every queue one run of consecutive jobs, then waits for the last of them */
+static int brc_run_batch(brc_engine_s * engine, brc_job_s * jobs, size_t num_jobs, const brc_batch_options_s * options, bool decoding) {
+	if(num_jobs == 0) return BRC_EXIT_SUCCESS;
+	brc_batch_s batch;
+	batch.jobs = jobs;
+	batch.decoding = decoding;
+	memset(&batch.options, 0, sizeof(batch.options));
+	if(options) batch.options = *options;
+	batch.remaining = num_jobs;
+	batch.failed = 0;
+
+	/* counted before they are queued, so the count never drops below the tasks actually there */
+	size_t first;
+	{
+		std::lock_guard<std::mutex> guard(engine->lock);
+		first = engine->next_queue;
+		engine->next_queue = (first + num_jobs) % engine->num_workers;
+		engine->queued += num_jobs;
+	}
+	size_t workers = engine->num_workers;
+	size_t per_worker = num_jobs / workers, extra = num_jobs % workers;
+	for(size_t w = 0, job = 0; w < workers && job < num_jobs; w++) {
+		size_t count = per_worker + (w < extra);
+		brc_worker_s * worker = &engine->workers[(first + w) % workers];
+		std::lock_guard<std::mutex> guard(worker->lock);
+		for(size_t i = 0; i < count; i++, job++) {
+			brc_task_s task = { &batch, job };
+			worker->tasks.push_back(task);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(engine->lock);
+		engine->wake.notify_all();
+	}
+
+	std::unique_lock<std::mutex> guard(batch.lock);
+	batch.done.wait(guard, [&]{ return batch.remaining == 0; });
+	return batch.failed ? BRC_EXIT_FAILURE : BRC_EXIT_SUCCESS;
+}
+
+int brc_encode_many(brc_engine_s * engine, brc_job_s * jobs, size_t num_jobs, const brc_batch_options_s * options) {
+	return brc_run_batch(engine, jobs, num_jobs, options, false);
+}
+
+int brc_decode_many(brc_engine_s * engine, brc_job_s * jobs, size_t num_jobs, const brc_batch_options_s * options) {
+	return brc_run_batch(engine, jobs, num_jobs, options, true);
+}
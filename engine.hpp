@@ -0,0 +1,48 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "brc.hpp"
+
+/*
+	Parallel engine: a pool of threads started once and kept for the life of the engine, each with its own
+	brc_cxt_s. A batch puts one task per block on the workers' queues; a worker takes from the front of its
+	own queue and, once that is empty, steals from the back of the others', so a few slow blocks never hold
+	the rest of the batch up. Any number of threads may submit batches to the same engine at once.
+*/
+
+#define BRC_ENGINE_PIN (1 << 0) /* pin worker t to logical cpu t */
+#define BRC_ENGINE_THP (1 << 1) /* contexts on transparent huge pages, see BRC_PAGES_THP */
+#define BRC_ENGINE_HUGE_PAGES (1 << 2) /* contexts on explicit huge pages, see BRC_PAGES_HUGE */
+
+/* coding options of a batch, NULL gives the defaults of brc_init_cxt; new fields go at the end so positional initialisers keep their meaning */
+struct brc_batch_options_s {
+	int segments;
+	int entropy;
+	int bwt;
+	brc_shared_s * shared;
+	int interleave; /* a decoding worker takes up to this many blocks of its queue at once and unranks them together */
+	int level; /* 1 to BRC_MAX_LEVEL, 0 takes BRC_MAX_LEVEL */
+};
+
+struct brc_engine_s;
+
+/* starts 'num_threads' workers, or one per logical cpu when 'num_threads' < 1; returns NULL on failure */
+brc_engine_s * brc_engine_create(int num_threads, int flags);
+
+/* waits for the workers to finish what they hold and frees the engine */
+void brc_engine_destroy(brc_engine_s * engine);
+
+int brc_engine_threads(brc_engine_s * engine);
+
+/* encodes every job and returns once all are done; returns 0 if every job succeeded, else -1 */
+int brc_encode_many(brc_engine_s * engine, brc_job_s * jobs, size_t num_jobs, const brc_batch_options_s * options);
+
+/* decodes every job, the batch options must match the encoder's shared table if it had one */
+int brc_decode_many(brc_engine_s * engine, brc_job_s * jobs, size_t num_jobs, const brc_batch_options_s * options);
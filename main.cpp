@@ -1,309 +1,1169 @@
-/*
-	BRC - Behemoth Rank Coding for BWT
-	MIT License
-	Copyright (c) 2018 Lucas Marsh
-	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
-	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
-	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-*/
-#include "brc.hpp"
-#include "common.hpp"
-
-#define BUFFER_SIZE (1 << 20)
-
-int encode_stream_serial(FILE * f_input, FILE * f_output) {
-	unsigned char * buffer = (unsigned char*)malloc(BUFFER_SIZE);
-	memset(buffer, 0, BUFFER_SIZE);
-	if(!buffer) 
-		return printf(" Failed to allocate input!  \n"), EXIT_FAILURE;
-
-	brc_cxt_s brc_cxt;
-	brc_init_cxt(&brc_cxt, BUFFER_SIZE);
-
-	time_t start; 
-	double cpu_time = 0;
-
-	size_t bytes_read;
-	size_t total_bytes_read = 0;
-	size_t total_bytes_written = 0;
-	while((bytes_read = fread(buffer, 1, BUFFER_SIZE, f_input)) > 0) {
-		total_bytes_read += bytes_read;
-		start = clock();
-
-		if(brc_encode(&brc_cxt, buffer, bytes_read) == BRC_EXIT_FAILURE) 
-			return printf(" Failed to encode input!  \n"), EXIT_FAILURE;
-
-		cpu_time += ((double)clock() - (double)start) / CLOCKS_PER_SEC;
-		fwrite(&brc_cxt.size, 1, sizeof(brc_cxt.size), f_output);
-		fwrite(brc_cxt.block, 1, brc_cxt.size, f_output);
-		total_bytes_written += brc_cxt.size;
-
-		printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \r", 
-			(long long)(total_bytes_read / 1000000),
-			(long long)(total_bytes_written / 1000000),
-			cpu_time,
-			((double)total_bytes_read /  1000000.f) / cpu_time
-		);
-	}
-
-	printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \n", 
-		(long long)(total_bytes_read / 1000000),
-		(long long)(total_bytes_written / 1000000),
-		cpu_time,
-		((double)total_bytes_read /  1000000.f) / cpu_time
-	);
-
-	free(buffer);
-	brc_free_cxt(&brc_cxt);
-	return EXIT_SUCCESS;
-}
-
-int decode_stream_serial(FILE * f_input, FILE * f_output) {
-	unsigned char * buffer = (unsigned char*)malloc(BUFFER_SIZE);
-	memset(buffer, 0, BUFFER_SIZE);
-	if(!buffer) 
-		return printf(" Failed to allocate output!  \n"), EXIT_FAILURE;
-
-	brc_cxt_s brc_cxt;
-	brc_init_cxt(&brc_cxt, BUFFER_SIZE);
-
-	time_t start; 
-	double cpu_time = 0;
-
-	size_t bytes_read;
-	size_t total_bytes_read = 0;
-	size_t total_bytes_written = 0;
-	while((bytes_read = fread(&brc_cxt.size, 1, sizeof(brc_cxt.size), f_input)) > 0) {
-		total_bytes_read += bytes_read;
-
-		if(brc_cxt.size > brc_cxt.eob) 
-			return printf(" Read invalid data!  \n"), EXIT_FAILURE;
-
-		bytes_read = fread(brc_cxt.block, 1, brc_cxt.size, f_input);
-		total_bytes_read += bytes_read;
-
-		size_t original_size;
-		start = clock();
-
-		if(brc_decode(&brc_cxt, buffer, &original_size) == BRC_EXIT_FAILURE) 
-			return printf(" Failed to decode input!  \n"), EXIT_FAILURE;
-
-		cpu_time += ((double)clock() - (double)start) / CLOCKS_PER_SEC;
-
-
-		fwrite(buffer, 1, original_size, f_output);
-		total_bytes_written += original_size;
-
-		printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \r", 
-			(long long)(total_bytes_read / 1000000),
-			(long long)(total_bytes_written / 1000000),
-			cpu_time,
-			((double)total_bytes_written /  1000000.f) / cpu_time
-		);
-	}
-
-	printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \n", 
-		(long long)(total_bytes_read / 1000000),
-		(long long)(total_bytes_written / 1000000),
-		cpu_time,
-		((double)total_bytes_written /  1000000.f) / cpu_time
-	);
-
-	free(buffer);
-	brc_free_cxt(&brc_cxt);
-	return EXIT_SUCCESS;
-}
-
-int encode_stream_parallel(FILE * f_input, FILE * f_output, int num_threads) {
-	brc_cxt_s brc_cxt[num_threads];
-	unsigned char * buffer[num_threads];
-
-	for(size_t t = 0; t < num_threads; t++) {
-		if(brc_init_cxt(&brc_cxt[t], BUFFER_SIZE) == BRC_EXIT_FAILURE)
-			return printf(" Failed to allocate brc cxt!  \n"), EXIT_FAILURE;
-		buffer[t] = (unsigned char*)malloc(BUFFER_SIZE);
-		memset(buffer[t], 0, BUFFER_SIZE);
-		if(!buffer[t]) 
-			return printf(" Failed to allocate output!  \n"), EXIT_FAILURE;
-	}
-
-	time_t start; 
-	double cpu_time = 0;
-	size_t bytes_read[num_threads] = {0};
-	size_t total_bytes_read = 0, total_bytes_written = 0;
-	int errs[num_threads] = {0};
-
-	while(1) {
-		int s = 0;
-		bool end = false;
-		for(; s < num_threads; s++) {
-			bytes_read[s] = fread(buffer[s], 1, BUFFER_SIZE, f_input);
-			if(bytes_read[s] == 0) {
-				end = true;
-				break;
-			}
-		}
-
-		start = clock();
-
-		#pragma omp parallel for num_threads(s)
-		for(int i = 0; i < s; i++) {
-			errs[i] = brc_encode(&brc_cxt[i], buffer[i], bytes_read[i]);
-		}
-
-		cpu_time += ((double)clock() - (double)start) / CLOCKS_PER_SEC;
-
-		for(int i = 0; i < s; i++) {
-			total_bytes_read += bytes_read[i];
-			total_bytes_written += brc_cxt[i].size + sizeof(brc_cxt[s].size);
-			fwrite(&brc_cxt[i].size, 1, sizeof(brc_cxt[i].size), f_output);
-			fwrite(brc_cxt[i].block, 1, brc_cxt[i].size, f_output);
-		}
-
-		printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \r", 
-			(long long)(total_bytes_read / 1000000),
-			(long long)(total_bytes_written / 1000000),
-			cpu_time,
-			((double)total_bytes_read /  1000000.f) / cpu_time
-		);
-
-
-		if(end) break;
-	}
-
-	printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \n", 
-		(long long)(total_bytes_read / 1000000),
-		(long long)(total_bytes_written / 1000000),
-		cpu_time,
-		((double)total_bytes_read /  1000000.f) / cpu_time
-	);
-
-	for(size_t t = 0; t < num_threads; t++) {
-		free(buffer[t]);
-		brc_free_cxt(&brc_cxt[t]);
-	}
-	return EXIT_SUCCESS;
-}
-
-int decode_stream_parallel(FILE * f_input, FILE * f_output, int num_threads) {
-	brc_cxt_s brc_cxt[num_threads];
-	unsigned char * buffer[num_threads];
-
-	for(size_t t = 0; t < num_threads; t++) {
-		if(brc_init_cxt(&brc_cxt[t], BUFFER_SIZE) == BRC_EXIT_FAILURE)
-			return printf(" Failed to allocate brc cxt!  \n"), EXIT_FAILURE;
-		buffer[t] = (unsigned char*)malloc(BUFFER_SIZE);
-		memset(buffer[t], 0, BUFFER_SIZE);
-		if(!buffer[t]) 
-			return printf(" Failed to allocate output!  \n"), EXIT_FAILURE;
-	}
-
-	time_t start; 
-	double cpu_time = 0;
-	size_t bytes_read[num_threads] = {0};
-	size_t original_sizes[num_threads] = {0};
-	size_t total_bytes_read = 0, total_bytes_written = 0;
-	int errs[num_threads] = {0};
-
-	while(1) {
-		int s = 0;
-		bool end = false;
-		for(; s < num_threads; s++) {
-			fread(&brc_cxt[s].size, 1, sizeof(brc_cxt[s].size), f_input);
-			if(brc_cxt[s].size > brc_cxt[s].eob) return printf(" Invalid input!  \n"), EXIT_FAILURE;
-			bytes_read[s] = fread(brc_cxt[s].block, 1, brc_cxt[s].size, f_input);
-			if(bytes_read[s] == 0) {
-				end = true;
-				break;
-			}
-		}
-
-		start = clock();
-
-		#pragma omp parallel for num_threads(s)
-		for(int i = 0; i < s; i++) {
-			errs[i] = brc_decode(&brc_cxt[i], buffer[i], &original_sizes[i]);
-		}
-
-		cpu_time += ((double)clock() - (double)start) / CLOCKS_PER_SEC;
-
-		for(int i = 0; i < s; i++) {
-			total_bytes_read += bytes_read[i] + sizeof(brc_cxt[s].size);
-			total_bytes_written += original_sizes[i];
-			fwrite(buffer[i], 1, original_sizes[i], f_output);
-		}
-
-		printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \r", 
-			(long long)(total_bytes_read / 1000000),
-			(long long)(total_bytes_written / 1000000),
-			cpu_time,
-			((double)total_bytes_written /  1000000.f) / cpu_time
-		);
-
-
-		if(end) break;
-	}
-
-	printf(" read %llu MB => %llu MB, cpu time = %.3f seconds, throughput = %.3f MB/s       \n", 
-		(long long)(total_bytes_read / 1000000),
-		(long long)(total_bytes_written / 1000000),
-		cpu_time,
-		((double)total_bytes_written /  1000000.f) / cpu_time
-	);
-
-	for(size_t t = 0; t < num_threads; t++) {
-		free(buffer[t]);
-		brc_free_cxt(&brc_cxt[t]);
-	}
-	return EXIT_SUCCESS;
-}
-
-int main(int argc, char ** argv) {
-	if(argc < 4) {
-		printf(" BRC version %i - Behemoth Rank Coding for BWT \n\
- Lucas Marsh (c) 2018, MIT licensed \n\
- Usage:  brc.exe  <c|d>  input  output  num-threads\n\
- Arguments: \n\
-    c : compress \n\
-    d : decompress \n\
- Press 'enter' to continue", BRC_VERSION);
-		getchar();
-		return 0;
-	}
-
-	if(strcmp(argv[2], argv[3]) == 0) return perror(" Refusing to write to input, change the output directory! \n"), EXIT_FAILURE;
-
-	FILE* f_input  = fopen(argv[2], "rb");
-	FILE* f_output = fopen(argv[3], "wb");
-	if (f_input  == NULL) return perror(argv[2]), 1;
-	if (f_output == NULL) return perror(argv[3]), 1;
-
-	int num_threads = 4;
-	if(argc > 4) num_threads = atoi(argv[4]);
-
-	switch(argv[1][0]) {
-		case 'c': {
-			if(num_threads > 1) {
-				if(encode_stream_parallel(f_input, f_output, num_threads) != EXIT_SUCCESS)
-					return printf(" Encoding failed!  \n"), EXIT_FAILURE;
-			} else {
-				if(encode_stream_serial(f_input, f_output) != EXIT_SUCCESS)
-					return printf(" Encoding failed!  \n"), EXIT_FAILURE;
-			}
-		} break;
-		case 'd': {
-			if(num_threads > 1) {
-				if(decode_stream_parallel(f_input, f_output, num_threads) != EXIT_SUCCESS)
-					return printf(" Decoding failed!  \n"), EXIT_FAILURE;
-			} else {
-				if(decode_stream_serial(f_input, f_output) != EXIT_SUCCESS)
-					return printf(" Decoding failed!  \n"), EXIT_FAILURE;
-			}
-		} break;
-		default: printf(" Invalid argument!\n");
-	}
-
-	fclose(f_input);
-	fclose(f_output);
-	return EXIT_SUCCESS;
-}
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "brc.hpp"
+#include "container.hpp"
+#include "bwt.hpp"
+#include "common.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define BUFFER_SIZE (1 << 20) /* default block size */
+#define MIN_BLOCK_SIZE (1 << 16) /* smallest block --memory will pick */
+#define BENCH_MAX_SWEEP (16)
+#define SPLIT_MIN_FRACTION (8) /* --split keeps both parts of a cut at least 1/8 of the block size */
+
+struct cli_options_s {
+	int num_threads;
+	int segments;
+	int interleave; /* blocks or segments decoded together on each thread */
+	uint64_t block_size;
+	uint64_t memory; /* budget for --memory, 0 when unlimited */
+	bool block_size_set;
+	uint64_t offset, length; /* byte range for 'r' */
+	bool mmap;
+	bool entropy;
+	bool bwt;
+	bool low_memory; /* code every block in place in one buffer, see brc_encode_inplace */
+	bool split; /* end blocks early where the statistics shift, see brc_split */
+	bool checksum; /* store the brc_checksum of every block, see BRC_FLAG_CHECKSUM */
+	int level; /* 1 to BRC_MAX_LEVEL, see brc_cxt_s */
+	int pages; /* BRC_PAGES_* the contexts are allocated with */
+	int iterations; /* benchmark repetitions */
+	bool json; /* benchmark report as JSON instead of CSV */
+	uint64_t block_sizes[BENCH_MAX_SWEEP], thread_counts[BENCH_MAX_SWEEP];
+	size_t num_block_sizes, num_thread_counts;
+	FILE * f_stats; /* per block statistics as JSON lines, NULL unless --stats */
+};
+
+static uint16_t cli_container_flags(const cli_options_s * opts) {
+	return (opts->entropy ? BRC_FLAG_ENTROPY : 0) | (opts->bwt ? BRC_FLAG_BWT : 0) | (opts->checksum ? BRC_FLAG_CHECKSUM : 0);
+}
+
+/* bytes of the 'size' read into 'src' that go into the next block, fewer than 'size' only with --split */
+static size_t cli_split(const cli_options_s * opts, unsigned char * src, size_t size) {
+	if(!opts->split) return size;
+	return brc_split(src, size, opts->block_size / SPLIT_MIN_FRACTION, opts->entropy);
+}
+
+/* a number with an optional K, M or G suffix; returns the first character after it, or NULL if there is no number */
+static const char * cli_parse_size(const char * arg, uint64_t * x) {
+	char * end;
+	*x = strtoull(arg, &end, 10);
+	if(end == arg) return NULL;
+	if(*end == 'K' || *end == 'k') *x <<= 10, end++;
+	else if(*end == 'M' || *end == 'm') *x <<= 20, end++;
+	else if(*end == 'G' || *end == 'g') *x <<= 30, end++;
+	return end;
+}
+
+/* size of a file opened for reading, 0 if it cannot be told */
+static uint64_t cli_file_size(FILE * f) {
+#ifdef _WIN32
+	if(_fseeki64(f, 0, SEEK_END) != 0) return 0;
+	int64_t size = _ftelli64(f);
+	_fseeki64(f, 0, SEEK_SET);
+#else
+	if(fseeko(f, 0, SEEK_END) != 0) return 0;
+	int64_t size = ftello(f);
+	fseeko(f, 0, SEEK_SET);
+#endif
+	return size > 0 ? size : 0;
+}
+
+/* what one pipeline slot holds for a block: the context's two buffers, the raw block and the BWT's suffix array */
+static uint64_t cli_slot_memory(uint64_t block_size, bool bwt) {
+	return 2 * (uint64_t)brc_safe_memory_bound(block_size) + block_size + (bwt ? sizeof(int32_t) * (block_size + 1) : 0);
+}
+
+/*
+	Fits threads and block size to the --memory budget, counting two slots per thread as the pipeline does.
+	Unless the block size is given, it is the largest power of two that leaves every thread a block of the
+	input and fits the budget with all threads; only when even the smallest block does not fit are threads
+	dropped. Decoding only ever drops threads, the block size being the encoder's.
+*/
+static int cli_fit_memory(cli_options_s * opts, uint64_t input_size, bool decoding) {
+	if(opts->memory == 0) return EXIT_SUCCESS;
+	if(!opts->block_size_set && !decoding) {
+		uint64_t limit = opts->bwt ? ((uint64_t)1 << 30) : ((uint64_t)1 << 40), share = (input_size + opts->num_threads - 1) / opts->num_threads;
+		uint64_t block_size = MIN_BLOCK_SIZE;
+		while(block_size < limit && block_size < share && 2 * opts->num_threads * cli_slot_memory(block_size * 2, opts->bwt) <= opts->memory)
+			block_size *= 2;
+		opts->block_size = block_size;
+	}
+	uint64_t threads = opts->memory / (2 * cli_slot_memory(opts->block_size, opts->bwt));
+	if(threads == 0) 
+		return printf(" %llu bytes of memory do not hold a block of %llu bytes! \n", (long long)opts->memory, (long long)opts->block_size), EXIT_FAILURE;
+	if(threads < (uint64_t)opts->num_threads) opts->num_threads = threads;
+	printf(" block size %llu, %i threads \n", (long long)opts->block_size, opts->num_threads);
+	return EXIT_SUCCESS;
+}
+
+/* one JSON object per block, 'stats' holding that block alone */
+static void cli_write_stats(FILE * f, uint64_t block, const brc_stats_s * stats) {
+	fprintf(f, "{\"block\": %llu, \"input_bytes\": %llu, \"packed_bytes\": %llu, \"unique_symbols\": %llu, \"rlt_fallback\": %s, \"entropy\": %s, \"run\": %s, \"stored\": %s, ",
+		(long long)block, (long long)stats->input_bytes, (long long)stats->packed_bytes, (long long)stats->unique_symbols, 
+		stats->rlt_fallbacks ? "true" : "false", stats->entropy_blocks ? "true" : "false", 
+		stats->run_blocks ? "true" : "false", stats->stored_blocks ? "true" : "false");
+	static const char * stage_names[BRC_STAGES] = { "rank", "mtf", "runs", "none" };
+	for(size_t i = 0; i < BRC_STAGES; i++)
+		if(stats->stages[i]) fprintf(f, "\"stage\": \"%s\", ", stage_names[i]);
+	fprintf(f, "\"escapes_fe\": %llu, \"escapes_ff\": %llu, \"zero_runs\": [", (long long)stats->escapes_fe, (long long)stats->escapes_ff);
+	size_t n = 64;
+	while(n > 1 && stats->zero_runs[n - 1] == 0) n--;
+	for(size_t i = 0; i < n; i++)
+		fprintf(f, "%s%llu", i ? ", " : "", (long long)stats->zero_runs[i]);
+	fprintf(f, "], \"ranks\": [");
+	for(size_t i = 0; i < 256; i++)
+		fprintf(f, "%s%llu", i ? ", " : "", (long long)stats->ranks[i]);
+	fprintf(f, "], \"cycles\": {\"bwt_forwards\": %llu, \"vsrc_forwards\": %llu, \"rlt_forwards\": %llu, \"rans_encode\": %llu}}\n",
+		(long long)stats->cycles.bwt_forwards, (long long)stats->cycles.vsrc_forwards, (long long)stats->cycles.rlt_forwards, (long long)stats->cycles.rans_encode);
+}
+
+int encode_stream_serial(FILE * f_input, FILE * f_output, cli_options_s * opts) {
+	unsigned char * buffer = (unsigned char*)malloc(opts->block_size);
+	if(!buffer) 
+		return printf(" Failed to allocate input!  \n"), EXIT_FAILURE;
+
+	brc_cxt_s brc_cxt;
+	if(brc_init_cxt_with(&brc_cxt, opts->block_size, brc_page_allocator(opts->pages)) == BRC_EXIT_FAILURE)
+		return printf(" Failed to allocate brc cxt!  \n"), EXIT_FAILURE;
+	brc_cxt.segments = opts->segments;
+	brc_cxt.entropy = opts->entropy;
+	brc_cxt.bwt = opts->bwt;
+	brc_cxt.level = opts->level;
+	brc_stats_s stats;
+	if(opts->f_stats) brc_cxt.stats = &stats;
+
+	brc_writer_s writer;
+	if(brc_writer_open(&writer, brc_file_sink, f_output, opts->block_size, cli_container_flags(opts)) == BRC_EXIT_FAILURE)
+		return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+
+	double start, elapsed = 0;
+
+	size_t bytes_read, buffered = 0;
+	size_t total_bytes_read = 0;
+	size_t total_bytes_written = 0;
+	while((buffered += fread(buffer + buffered, 1, opts->block_size - buffered, f_input)) > 0) {
+		bytes_read = cli_split(opts, buffer, buffered);
+		total_bytes_read += bytes_read;
+		memset(&stats, 0, sizeof(stats));
+		start = omp_get_wtime();
+
+		uint32_t checksum = opts->checksum ? brc_checksum(buffer, bytes_read) : 0;
+		if(brc_encode(&brc_cxt, buffer, bytes_read) == BRC_EXIT_FAILURE) 
+			return printf(" Failed to encode input!  \n"), EXIT_FAILURE;
+
+		elapsed += omp_get_wtime() - start;
+		if(opts->f_stats) cli_write_stats(opts->f_stats, writer.num_blocks, &stats);
+		if(brc_writer_add_block(&writer, brc_cxt.block, brc_cxt.size, bytes_read, checksum) == BRC_EXIT_FAILURE)
+			return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+		total_bytes_written = writer.offset;
+
+		printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \r", 
+			(long long)(total_bytes_read / 1000000),
+			(long long)(total_bytes_written / 1000000),
+			elapsed,
+			((double)total_bytes_read /  1000000.f) / elapsed
+		);
+
+		/* the rest of a split read starts the next block */
+		buffered -= bytes_read;
+		memmove(buffer, buffer + bytes_read, buffered);
+	}
+
+	printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+		(long long)(total_bytes_read / 1000000),
+		(long long)(total_bytes_written / 1000000),
+		elapsed,
+		((double)total_bytes_read /  1000000.f) / elapsed
+	);
+
+	free(buffer);
+	brc_free_cxt(&brc_cxt);
+	if(brc_writer_close(&writer) == BRC_EXIT_FAILURE)
+		return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+int decode_stream_serial(FILE * f_input, FILE * f_output, cli_options_s * opts) {
+	brc_header_s header;
+	if(brc_read_header(f_input, &header) == BRC_EXIT_FAILURE)
+		return EXIT_FAILURE;
+
+	unsigned char * buffer = (unsigned char*)malloc(header.block_size);
+	if(!buffer) 
+		return printf(" Failed to allocate output!  \n"), EXIT_FAILURE;
+
+	brc_cxt_s brc_cxt;
+	if(brc_init_cxt_with(&brc_cxt, header.block_size, brc_page_allocator(opts->pages)) == BRC_EXIT_FAILURE)
+		return printf(" Failed to allocate brc cxt!  \n"), EXIT_FAILURE;
+	brc_cxt.interleave = opts->interleave;
+
+	double start, elapsed = 0;
+
+	int status;
+	brc_block_header_s block_header;
+	size_t total_bytes_read = sizeof(header);
+	size_t total_bytes_written = 0;
+	while((status = brc_read_block_header(f_input, &header, &block_header)) == BRC_EXIT_SUCCESS) {
+		brc_cxt.size = block_header.packed_size;
+		if(fread(brc_cxt.block, 1, brc_cxt.size, f_input) != brc_cxt.size)
+			return printf(" Unexpected end of input!  \n"), EXIT_FAILURE;
+		total_bytes_read += sizeof(block_header) + brc_cxt.size;
+
+		size_t original_size;
+		start = omp_get_wtime();
+
+		if(brc_decode(&brc_cxt, buffer, &original_size) == BRC_EXIT_FAILURE || original_size != block_header.original_size) 
+			return printf(" Failed to decode input!  \n"), EXIT_FAILURE;
+
+		elapsed += omp_get_wtime() - start;
+
+		fwrite(buffer, 1, original_size, f_output);
+		total_bytes_written += original_size;
+
+		printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \r", 
+			(long long)(total_bytes_read / 1000000),
+			(long long)(total_bytes_written / 1000000),
+			elapsed,
+			((double)total_bytes_written /  1000000.f) / elapsed
+		);
+	}
+
+	printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+		(long long)(total_bytes_read / 1000000),
+		(long long)(total_bytes_written / 1000000),
+		elapsed,
+		((double)total_bytes_written /  1000000.f) / elapsed
+	);
+
+	free(buffer);
+	brc_free_cxt(&brc_cxt);
+	return status == BRC_EXIT_FAILURE ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --low-memory: one buffer of brc_inplace_bound bytes holds each block from the read to the write, on one thread */
+int encode_stream_inplace(FILE * f_input, FILE * f_output, cli_options_s * opts) {
+	size_t capacity = brc_inplace_bound(opts->block_size);
+	unsigned char * buffer = (unsigned char*)malloc(capacity);
+	if(!buffer) 
+		return printf(" Failed to allocate input!  \n"), EXIT_FAILURE;
+
+	brc_writer_s writer;
+	if(brc_writer_open(&writer, brc_file_sink, f_output, opts->block_size, cli_container_flags(opts)) == BRC_EXIT_FAILURE)
+		return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+
+	double start, elapsed = 0;
+
+	size_t bytes_read, packed_size;
+	size_t total_bytes_read = 0;
+	while((bytes_read = fread(buffer, 1, opts->block_size, f_input)) > 0) {
+		total_bytes_read += bytes_read;
+		start = omp_get_wtime();
+
+		/* the block is packed over its input, so the checksum comes first */
+		uint32_t checksum = opts->checksum ? brc_checksum(buffer, bytes_read) : 0;
+		if(brc_encode_inplace(buffer, bytes_read, capacity, opts->level, &packed_size) == BRC_EXIT_FAILURE) 
+			return printf(" Failed to encode input!  \n"), EXIT_FAILURE;
+
+		elapsed += omp_get_wtime() - start;
+		if(brc_writer_add_block(&writer, buffer, packed_size, bytes_read, checksum) == BRC_EXIT_FAILURE)
+			return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+	}
+
+	printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+		(long long)(total_bytes_read / 1000000),
+		(long long)(writer.offset / 1000000),
+		elapsed,
+		((double)total_bytes_read /  1000000.f) / elapsed
+	);
+
+	free(buffer);
+	if(brc_writer_close(&writer) == BRC_EXIT_FAILURE)
+		return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+int decode_stream_inplace(FILE * f_input, FILE * f_output) {
+	brc_header_s header;
+	if(brc_read_header(f_input, &header) == BRC_EXIT_FAILURE)
+		return EXIT_FAILURE;
+
+	/* the checksums are stored after the blocks, so they are loaded from the index up front */
+	brc_index_s index;
+	index.checksums = NULL;
+	if(header.flags & BRC_FLAG_CHECKSUM) {
+		if(brc_read_index(f_input, &index) == BRC_EXIT_FAILURE || fseek(f_input, sizeof(header), SEEK_SET) != 0)
+			return printf(" Cannot check the block checksums without the block index!  \n"), EXIT_FAILURE;
+	}
+
+	size_t capacity = brc_inplace_bound(header.block_size);
+	unsigned char * buffer = (unsigned char*)malloc(capacity);
+	if(!buffer) 
+		return printf(" Failed to allocate output!  \n"), EXIT_FAILURE;
+
+	double start, elapsed = 0;
+
+	int status;
+	brc_block_header_s block_header;
+	size_t total_bytes_read = sizeof(header);
+	size_t total_bytes_written = 0;
+	uint64_t num_blocks = 0;
+	while((status = brc_read_block_header(f_input, &header, &block_header)) == BRC_EXIT_SUCCESS) {
+		if(block_header.packed_size > capacity || fread(buffer, 1, block_header.packed_size, f_input) != block_header.packed_size)
+			return printf(" Unexpected end of input!  \n"), EXIT_FAILURE;
+		total_bytes_read += sizeof(block_header) + block_header.packed_size;
+
+		size_t original_size;
+		start = omp_get_wtime();
+
+		if(brc_decode_inplace(buffer, block_header.packed_size, capacity, &original_size) == BRC_EXIT_FAILURE || original_size != block_header.original_size) 
+			return printf(" Failed to decode input!  \n"), EXIT_FAILURE;
+
+		if(index.checksums && (num_blocks >= index.num_blocks || brc_checksum(buffer, original_size) != index.checksums[num_blocks]))
+			return printf(" Block %llu is corrupt! \n", (long long)num_blocks), EXIT_FAILURE;
+
+		elapsed += omp_get_wtime() - start;
+
+		fwrite(buffer, 1, original_size, f_output);
+		total_bytes_written += original_size;
+		num_blocks++;
+	}
+
+	printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+		(long long)(total_bytes_read / 1000000),
+		(long long)(total_bytes_written / 1000000),
+		elapsed,
+		((double)total_bytes_written /  1000000.f) / elapsed
+	);
+
+	free(buffer);
+	if(index.checksums) brc_free_index(&index);
+	return status == BRC_EXIT_FAILURE ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*** pipelined parallel streaming ***/
+/*
+	Blocks flow through a ring of slots: the reader thread fills slots in order, any free worker
+	transforms the oldest filled slot, and the calling thread writes finished slots back in order.
+	The ring holds two slots per worker so reads and writes overlap the transforms.
+*/
+enum { SLOT_EMPTY, SLOT_READ, SLOT_BUSY, SLOT_DONE };
+
+struct pipe_slot_s {
+	brc_cxt_s brc_cxt;
+	brc_stats_s stats; /* of the block in this slot when --stats is given */
+	unsigned char * buffer;
+	unsigned char * input; /* either 'buffer' or a window of the mapped input */
+	size_t bytes_read;
+	size_t original_size;
+	bool checked; /* --checksum: encoding takes the checksum of the input first */
+	uint32_t checksum;
+	int state;
+	int err;
+};
+
+struct pipe_s {
+	pipe_slot_s * slots;
+	size_t num_slots;
+	size_t next_read, next_work, next_write;
+	bool eof, failed;
+	FILE * f_input;
+	FILE * f_output;
+	std::mutex lock;
+	std::condition_variable cv;
+	/* per stage callbacks, 'read' returns false at the end of input; byte totals belong to the writer */
+	bool (*read)(pipe_s * pipe, pipe_slot_s * slot);
+	int (*work)(pipe_slot_s * slot);
+	void (*write)(pipe_s * pipe, pipe_slot_s * slot);
+	size_t total_bytes_read, total_bytes_written;
+	bool decoding;
+	cli_options_s * opts;
+	brc_header_s header;
+	brc_writer_s writer;
+	brc_mmap_s * mapped; /* input is read straight from this map when set */
+	size_t mapped_pos;
+	unsigned char * carry; /* input read past a --split cut, the start of the next block */
+	size_t carry_size;
+};
+
+static void pipe_reader(pipe_s * pipe) {
+	for(size_t seq = 0; ; seq++) {
+		pipe_slot_s * slot = &pipe->slots[seq % pipe->num_slots];
+		{
+			std::unique_lock<std::mutex> guard(pipe->lock);
+			pipe->cv.wait(guard, [&]{ return slot->state == SLOT_EMPTY || pipe->failed; });
+			if(pipe->failed) break;
+		}
+		bool more = pipe->read(pipe, slot);
+		std::lock_guard<std::mutex> guard(pipe->lock);
+		if(!more) break;
+		slot->state = SLOT_READ;
+		pipe->next_read++;
+		pipe->cv.notify_all();
+	}
+	std::lock_guard<std::mutex> guard(pipe->lock);
+	pipe->eof = true;
+	pipe->cv.notify_all();
+}
+
+static void pipe_worker(pipe_s * pipe) {
+	while(1) {
+		pipe_slot_s * slot;
+		{
+			std::unique_lock<std::mutex> guard(pipe->lock);
+			pipe->cv.wait(guard, [&]{ return pipe->next_work < pipe->next_read || pipe->eof || pipe->failed; });
+			if(pipe->failed || pipe->next_work == pipe->next_read) return;
+			slot = &pipe->slots[pipe->next_work++ % pipe->num_slots];
+			slot->state = SLOT_BUSY;
+		}
+		int err = pipe->work(slot);
+		std::lock_guard<std::mutex> guard(pipe->lock);
+		slot->err = err;
+		slot->state = SLOT_DONE;
+		pipe->cv.notify_all();
+	}
+}
+
+static int pipe_run(pipe_s * pipe) {
+	int num_threads = pipe->opts->num_threads;
+	pipe->num_slots = 2 * num_threads;
+	pipe->slots = (pipe_slot_s*)calloc(pipe->num_slots, sizeof(pipe_slot_s));
+	if(!pipe->slots)
+		return printf(" Failed to allocate pipeline!  \n"), EXIT_FAILURE;
+
+	int err = EXIT_SUCCESS;
+	for(size_t t = 0; t < pipe->num_slots; t++) {
+		pipe_slot_s * slot = &pipe->slots[t];
+		if(brc_init_cxt_with(&slot->brc_cxt, pipe->header.block_size, brc_page_allocator(pipe->opts->pages)) == BRC_EXIT_FAILURE) {
+			slot->brc_cxt.block = NULL;
+			err = (printf(" Failed to allocate brc cxt!  \n"), EXIT_FAILURE);
+			break;
+		}
+		slot->brc_cxt.segments = pipe->opts->segments;
+		slot->brc_cxt.interleave = pipe->opts->interleave;
+		slot->brc_cxt.entropy = pipe->opts->entropy;
+		slot->brc_cxt.bwt = pipe->opts->bwt;
+		slot->brc_cxt.level = pipe->opts->level;
+		if(pipe->opts->f_stats) slot->brc_cxt.stats = &slot->stats;
+		slot->checked = pipe->opts->checksum;
+		if(pipe->mapped) continue;
+		slot->buffer = (unsigned char*)malloc(pipe->header.block_size);
+		if(!slot->buffer) {
+			err = (printf(" Failed to allocate output!  \n"), EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if(err == EXIT_SUCCESS) {
+		double start = omp_get_wtime(), elapsed = 0;
+		std::thread reader(pipe_reader, pipe);
+		std::thread * workers = new std::thread[num_threads];
+		for(int t = 0; t < num_threads; t++)
+			workers[t] = std::thread(pipe_worker, pipe);
+
+		for(size_t seq = 0; ; seq++) {
+			pipe_slot_s * slot = &pipe->slots[seq % pipe->num_slots];
+			{
+				std::unique_lock<std::mutex> guard(pipe->lock);
+				pipe->cv.wait(guard, [&]{ return slot->state == SLOT_DONE || (pipe->eof && seq == pipe->next_read) || pipe->failed; });
+				if(pipe->failed || slot->state != SLOT_DONE) break;
+				if(slot->err == BRC_EXIT_FAILURE) {
+					pipe->failed = true;
+					pipe->cv.notify_all();
+					break;
+				}
+			}
+			pipe->write(pipe, slot);
+			elapsed = omp_get_wtime() - start;
+			printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \r", 
+				(long long)(pipe->total_bytes_read / 1000000),
+				(long long)(pipe->total_bytes_written / 1000000),
+				elapsed,
+				((double)(pipe->decoding ? pipe->total_bytes_written : pipe->total_bytes_read) /  1000000.f) / elapsed
+			);
+			std::lock_guard<std::mutex> guard(pipe->lock);
+			slot->state = SLOT_EMPTY;
+			pipe->next_write++;
+			pipe->cv.notify_all();
+		}
+
+		reader.join();
+		for(int t = 0; t < num_threads; t++)
+			workers[t].join();
+		delete[] workers;
+
+		printf(" read %llu MB => %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+			(long long)(pipe->total_bytes_read / 1000000),
+			(long long)(pipe->total_bytes_written / 1000000),
+			elapsed,
+			((double)(pipe->decoding ? pipe->total_bytes_written : pipe->total_bytes_read) /  1000000.f) / elapsed
+		);
+		if(pipe->failed) err = EXIT_FAILURE;
+	}
+
+	for(size_t t = 0; t < pipe->num_slots; t++) {
+		if(pipe->slots[t].brc_cxt.block) brc_free_cxt(&pipe->slots[t].brc_cxt);
+		free(pipe->slots[t].buffer);
+	}
+	free(pipe->slots);
+	return err;
+}
+
+static bool encode_read(pipe_s * pipe, pipe_slot_s * slot) {
+	size_t buffered = pipe->carry_size;
+	memcpy(slot->buffer, pipe->carry, buffered);
+	buffered += fread(slot->buffer + buffered, 1, pipe->header.block_size - buffered, pipe->f_input);
+	slot->bytes_read = cli_split(pipe->opts, slot->buffer, buffered);
+	slot->input = slot->buffer;
+	pipe->carry_size = buffered - slot->bytes_read;
+	memcpy(pipe->carry, slot->buffer + slot->bytes_read, pipe->carry_size);
+	return slot->bytes_read > 0;
+}
+
+static bool encode_read_mapped(pipe_s * pipe, pipe_slot_s * slot) {
+	size_t left = pipe->mapped->size - pipe->mapped_pos;
+	slot->input = pipe->mapped->data + pipe->mapped_pos;
+	slot->bytes_read = cli_split(pipe->opts, slot->input, left < pipe->header.block_size ? left : pipe->header.block_size);
+	pipe->mapped_pos += slot->bytes_read;
+	return slot->bytes_read > 0;
+}
+
+static int encode_work(pipe_slot_s * slot) {
+	memset(&slot->stats, 0, sizeof(slot->stats));
+	slot->checksum = slot->checked ? brc_checksum(slot->input, slot->bytes_read) : 0;
+	return brc_encode(&slot->brc_cxt, slot->input, slot->bytes_read);
+}
+
+static void pipe_fail(pipe_s * pipe, const char * msg) {
+	printf("%s", msg);
+	std::lock_guard<std::mutex> guard(pipe->lock);
+	pipe->failed = true;
+	pipe->cv.notify_all();
+}
+
+static void encode_write(pipe_s * pipe, pipe_slot_s * slot) {
+	if(pipe->opts->f_stats) cli_write_stats(pipe->opts->f_stats, pipe->writer.num_blocks, &slot->stats);
+	if(brc_writer_add_block(&pipe->writer, slot->brc_cxt.block, slot->brc_cxt.size, slot->bytes_read, slot->checksum) == BRC_EXIT_FAILURE)
+		return pipe_fail(pipe, " Failed to write output!  \n");
+	pipe->total_bytes_read += slot->bytes_read;
+	pipe->total_bytes_written = pipe->writer.offset;
+}
+
+static bool decode_read(pipe_s * pipe, pipe_slot_s * slot) {
+	brc_block_header_s block_header;
+	int status = brc_read_block_header(pipe->f_input, &pipe->header, &block_header);
+	if(status != BRC_EXIT_SUCCESS) {
+		if(status == BRC_EXIT_FAILURE) pipe_fail(pipe, "");
+		return false;
+	}
+	slot->brc_cxt.size = block_header.packed_size;
+	slot->original_size = block_header.original_size;
+	slot->bytes_read = fread(slot->brc_cxt.block, 1, slot->brc_cxt.size, pipe->f_input);
+	if(slot->bytes_read != slot->brc_cxt.size) {
+		pipe_fail(pipe, " Unexpected end of input!  \n");
+		return false;
+	}
+	return true;
+}
+
+static int decode_work(pipe_slot_s * slot) {
+	size_t expected = slot->original_size;
+	if(brc_decode(&slot->brc_cxt, slot->buffer, &slot->original_size) == BRC_EXIT_FAILURE || slot->original_size != expected)
+		return BRC_EXIT_FAILURE;
+	return BRC_EXIT_SUCCESS;
+}
+
+static void decode_write(pipe_s * pipe, pipe_slot_s * slot) {
+	if(fwrite(slot->buffer, 1, slot->original_size, pipe->f_output) != slot->original_size)
+		return pipe_fail(pipe, " Failed to write output!  \n");
+	pipe->total_bytes_read += slot->bytes_read + sizeof(brc_block_header_s);
+	pipe->total_bytes_written += slot->original_size;
+}
+
+int encode_stream_parallel(FILE * f_input, FILE * f_output, cli_options_s * opts) {
+	pipe_s pipe;
+	pipe.next_read = pipe.next_work = pipe.next_write = 0;
+	pipe.eof = pipe.failed = false;
+	pipe.f_input = f_input;
+	pipe.f_output = f_output;
+	pipe.read = encode_read;
+	pipe.work = encode_work;
+	pipe.write = encode_write;
+	pipe.total_bytes_read = pipe.total_bytes_written = 0;
+	pipe.decoding = false;
+	pipe.opts = opts;
+	pipe.mapped = NULL;
+	pipe.carry_size = 0;
+	pipe.carry = opts->split ? (unsigned char*)malloc(opts->block_size) : NULL;
+	if(opts->split && !pipe.carry)
+		return printf(" Failed to allocate input!  \n"), EXIT_FAILURE;
+	pipe.header.block_size = opts->block_size;
+	if(brc_writer_open(&pipe.writer, brc_file_sink, f_output, opts->block_size, cli_container_flags(opts)) == BRC_EXIT_FAILURE)
+		return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+	int err = pipe_run(&pipe);
+	free(pipe.carry);
+	if(brc_writer_close(&pipe.writer) == BRC_EXIT_FAILURE)
+		return printf(" Failed to write output!  \n"), EXIT_FAILURE;
+	return err;
+}
+
+int decode_stream_parallel(FILE * f_input, FILE * f_output, cli_options_s * opts) {
+	pipe_s pipe;
+	pipe.next_read = pipe.next_work = pipe.next_write = 0;
+	pipe.eof = pipe.failed = false;
+	pipe.f_input = f_input;
+	pipe.f_output = f_output;
+	pipe.read = decode_read;
+	pipe.work = decode_work;
+	pipe.write = decode_write;
+	pipe.total_bytes_read = pipe.total_bytes_written = 0;
+	pipe.decoding = true;
+	pipe.opts = opts;
+	pipe.mapped = NULL;
+	if(brc_read_header(f_input, &pipe.header) == BRC_EXIT_FAILURE)
+		return EXIT_FAILURE;
+	return pipe_run(&pipe);
+}
+
+/*** memory mapped streaming ***/
+/* the input is never copied: blocks are encoded from the map and packed blocks go once into the mapped output */
+int encode_mapped(const char * input, const char * output, cli_options_s * opts) {
+	brc_mmap_s in, out;
+	if(brc_mmap_open(&in, input) == BRC_EXIT_FAILURE) return perror(input), EXIT_FAILURE;
+	if(brc_mmap_create(&out, output, brc_container_bound(in.size, opts->block_size)) == BRC_EXIT_FAILURE) 
+		return perror(output), brc_mmap_close(&in, in.size), EXIT_FAILURE;
+
+	brc_mem_sink_s sink = { out.data, 0, out.size };
+	pipe_s pipe;
+	pipe.next_read = pipe.next_work = pipe.next_write = 0;
+	pipe.eof = pipe.failed = false;
+	pipe.f_input = pipe.f_output = NULL;
+	pipe.read = encode_read_mapped;
+	pipe.work = encode_work;
+	pipe.write = encode_write;
+	pipe.total_bytes_read = pipe.total_bytes_written = 0;
+	pipe.decoding = false;
+	pipe.opts = opts;
+	pipe.mapped = &in;
+	pipe.mapped_pos = 0;
+	pipe.carry = NULL;
+	pipe.carry_size = 0;
+	pipe.header.block_size = opts->block_size;
+
+	int err = EXIT_FAILURE;
+	if(brc_writer_open(&pipe.writer, brc_mem_sink, &sink, opts->block_size, cli_container_flags(opts)) == BRC_EXIT_SUCCESS) {
+		err = pipe_run(&pipe);
+		if(brc_writer_close(&pipe.writer) == BRC_EXIT_FAILURE) err = EXIT_FAILURE;
+	}
+	brc_mmap_close(&in, in.size);
+	if(brc_mmap_close(&out, sink.size) == BRC_EXIT_FAILURE) err = EXIT_FAILURE;
+	return err;
+}
+
+/* every block is decoded from the mapped input directly into its place in the mapped output */
+int decode_mapped(const char * input, const char * output, cli_options_s * opts) {
+	brc_mmap_s in, out;
+	brc_index_s index;
+	if(brc_mmap_open(&in, input) == BRC_EXIT_FAILURE) return perror(input), EXIT_FAILURE;
+	if(brc_read_index_mem(in.data, in.size, &index) == BRC_EXIT_FAILURE) 
+		return brc_mmap_close(&in, in.size), EXIT_FAILURE;
+	if(brc_mmap_create(&out, output, index.original_size) == BRC_EXIT_FAILURE) 
+		return perror(output), brc_free_index(&index), brc_mmap_close(&in, in.size), EXIT_FAILURE;
+
+	double start = omp_get_wtime();
+	int err = brc_decode_mem(in.data, &index, out.data, opts->num_threads, opts->interleave);
+	double elapsed = omp_get_wtime() - start;
+
+	printf(" %llu blocks, wrote %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+		(long long)index.num_blocks,
+		(long long)(index.original_size / 1000000),
+		elapsed,
+		((double)index.original_size /  1000000.f) / elapsed
+	);
+
+	brc_free_index(&index);
+	brc_mmap_close(&in, in.size);
+	brc_mmap_close(&out, out.size);
+	return err == BRC_EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* 't': every block is decoded from the mapped container into scratch memory and checked, nothing is written */
+int verify_mapped(const char * input, cli_options_s * opts) {
+	brc_mmap_s in;
+	brc_index_s index;
+	if(brc_mmap_open(&in, input) == BRC_EXIT_FAILURE) return perror(input), EXIT_FAILURE;
+	if(brc_read_index_mem(in.data, in.size, &index) == BRC_EXIT_FAILURE) 
+		return brc_mmap_close(&in, in.size), EXIT_FAILURE;
+
+	double start = omp_get_wtime();
+	int err = brc_decode_mem(in.data, &index, NULL, opts->num_threads, opts->interleave);
+	double elapsed = omp_get_wtime() - start;
+
+	printf(" %llu blocks, verified %llu MB %s, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+		(long long)index.num_blocks,
+		(long long)(index.original_size / 1000000),
+		index.checksums ? "against their checksums" : "by decoding only, the container has no checksums",
+		elapsed,
+		((double)index.original_size /  1000000.f) / elapsed
+	);
+
+	brc_free_index(&index);
+	brc_mmap_close(&in, in.size);
+	return err == BRC_EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* decodes straight from the block index, every block is handed to a thread without walking the stream; 'indexed' tells whether there was an index */
+int decode_indexed(FILE * f_input, FILE * f_output, cli_options_s * opts, uint64_t begin, uint64_t end, bool * indexed) {
+	brc_index_s index;
+	*indexed = brc_read_index(f_input, &index) == BRC_EXIT_SUCCESS;
+	if(!*indexed) 
+		return EXIT_FAILURE;
+
+	double start = omp_get_wtime();
+	int err = brc_decode_range(f_input, &index, begin, end, f_output, opts->num_threads, opts->interleave);
+	double elapsed = omp_get_wtime() - start;
+	if(end > index.original_size) end = index.original_size;
+	uint64_t written = end > begin ? end - begin : 0;
+
+	printf(" %llu blocks, wrote %llu MB, time = %.3f seconds, throughput = %.3f MB/s       \n", 
+		(long long)index.num_blocks,
+		(long long)(written / 1000000),
+		elapsed,
+		((double)written /  1000000.f) / elapsed
+	);
+	brc_free_index(&index);
+	return err == BRC_EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*** in-memory benchmark ***/
+struct bench_result_s {
+	uint64_t block_size;
+	int threads;
+	size_t packed_size;
+	double encode, decode; /* wall clock seconds per iteration */
+	brc_timings_s stages; /* seconds per iteration, added up over all threads */
+	bool roundtrip;
+};
+
+/* comma separated sizes with an optional K, M or G suffix, returns how many were read or 0 on a malformed list */
+static size_t cli_parse_list(const char * arg, uint64_t * list, size_t capacity) {
+	size_t n = 0;
+	while(*arg) {
+		if(n == capacity) return 0;
+		const char * end = cli_parse_size(arg, &list[n++]);
+		if(end == NULL || (*end != ',' && *end != 0)) return 0;
+		arg = *end ? end + 1 : end;
+	}
+	return n;
+}
+
+/* one point of the sweep: encode and decode the whole corpus in blocks of 'block_size' on 'threads' threads */
+static int bench_config(unsigned char * corpus, size_t size, size_t block_size, int threads, cli_options_s * opts, bench_result_s * result) {
+	size_t num_blocks = (size + block_size - 1) / block_size;
+	size_t bound = brc_safe_memory_bound(block_size);
+	size_t interleave = opts->interleave, groups = (num_blocks + interleave - 1) / interleave;
+	brc_cxt_s * cxts = (brc_cxt_s*)calloc(threads * interleave, sizeof(brc_cxt_s));
+	brc_timings_s * timings = (brc_timings_s*)calloc(threads, sizeof(brc_timings_s));
+	unsigned char * packed = (unsigned char*)malloc(num_blocks * bound);
+	size_t * packed_sizes = (size_t*)calloc(num_blocks, sizeof(size_t));
+	unsigned char * decoded = (unsigned char*)malloc(size);
+	int failed = !cxts || !timings || !packed || !packed_sizes || !decoded;
+	for(size_t c = 0; c < threads * interleave && !failed; c++) {
+		failed = brc_init_cxt_with(&cxts[c], block_size, brc_page_allocator(opts->pages)) == BRC_EXIT_FAILURE;
+		cxts[c].segments = opts->segments;
+		cxts[c].interleave = opts->interleave;
+		cxts[c].entropy = opts->entropy;
+		cxts[c].bwt = opts->bwt;
+		cxts[c].level = opts->level;
+		cxts[c].timings = &timings[c / interleave];
+	}
+	if(failed) printf(" Failed to allocate benchmark!  \n");
+
+	double start = omp_get_wtime();
+	for(int it = 0; it < opts->iterations && !failed; it++) {
+		#pragma omp parallel for num_threads(threads) schedule(dynamic, 1) reduction(|:failed)
+		for(long long b = 0; b < (long long)num_blocks; b++) {
+			brc_cxt_s * cxt = &cxts[omp_get_thread_num() * interleave];
+			size_t offset = b * block_size, len = size - offset < block_size ? size - offset : block_size;
+			if(brc_encode(cxt, corpus + offset, len) == BRC_EXIT_FAILURE) {
+				failed = 1;
+				continue;
+			}
+			memcpy(packed + b * bound, cxt->block, cxt->size);
+			packed_sizes[b] = cxt->size;
+		}
+	}
+	result->encode = (omp_get_wtime() - start) / opts->iterations;
+
+	start = omp_get_wtime();
+	for(int it = 0; it < opts->iterations && !failed; it++) {
+		#pragma omp parallel for num_threads(threads) schedule(dynamic, 1) reduction(|:failed)
+		for(long long g = 0; g < (long long)groups; g++) {
+			brc_job_s jobs[BRC_MAX_INTERLEAVE];
+			size_t n = 0;
+			for(size_t b = g * interleave; b < num_blocks && n < interleave; b++, n++) {
+				size_t offset = b * block_size;
+				jobs[n].src = packed + b * bound;
+				jobs[n].src_size = packed_sizes[b];
+				jobs[n].dst = decoded + offset;
+				jobs[n].dst_capacity = size - offset < block_size ? size - offset : block_size;
+			}
+			if(brc_decode_interleaved(&cxts[omp_get_thread_num() * interleave], jobs, n) == BRC_EXIT_FAILURE)
+				failed = 1;
+			for(size_t j = 0; j < n; j++)
+				if(jobs[j].dst_size != jobs[j].dst_capacity) failed = 1;
+		}
+	}
+	result->decode = (omp_get_wtime() - start) / opts->iterations;
+
+	result->block_size = block_size;
+	result->threads = threads;
+	result->packed_size = 0;
+	for(size_t b = 0; b < num_blocks && !failed; b++)
+		result->packed_size += packed_sizes[b];
+	result->roundtrip = !failed && memcmp(decoded, corpus, size) == 0;
+
+	double * sum = (double*)&result->stages;
+	memset(sum, 0, sizeof(brc_timings_s));
+	for(int t = 0; t < threads && timings; t++) {
+		double * stage = (double*)&timings[t];
+		for(size_t i = 0; i < sizeof(brc_timings_s) / sizeof(double); i++)
+			sum[i] += stage[i] / opts->iterations;
+	}
+
+	for(size_t c = 0; c < threads * interleave && cxts; c++)
+		if(cxts[c].block) brc_free_cxt(&cxts[c]);
+	free(cxts);
+	free(timings);
+	free(packed);
+	free(packed_sizes);
+	free(decoded);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static const char * bench_stage_names[] = {
+	"bwt_forwards", "vsrc_forwards", "rlt_forwards", "rans_encode",
+	"rans_decode", "rlt_reverse", "vsrc_reverse", "bwt_reverse"
+};
+
+/* writes 's' as a quoted JSON string, a corpus path may hold backslashes, quotes or control characters */
+static void bench_json_string(FILE * f, const char * s) {
+	fputc('"', f);
+	for(; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if(c == '"' || c == '\\') fprintf(f, "\\%c", c);
+		else if(c < 0x20) fprintf(f, "\\u%04x", c);
+		else fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void bench_report(FILE * f, const char * corpus_name, size_t size, cli_options_s * opts, bench_result_s * results, size_t num_results) {
+	if(opts->json) {
+		fprintf(f, "{\"version\": %i, \"simd\": \"%s\", \"corpus\": ", BRC_VERSION, brc_simd_name());
+		bench_json_string(f, corpus_name);
+		fprintf(f, ", \"input_bytes\": %llu, \"iterations\": %i, \"results\": [\n", (long long)size, opts->iterations);
+	} else {
+		fprintf(f, "version,simd,block_size,threads,iterations,input_bytes,packed_bytes,encode_mbps,decode_mbps");
+		for(size_t i = 0; i < sizeof(bench_stage_names) / sizeof(bench_stage_names[0]); i++)
+			fprintf(f, ",%s_s", bench_stage_names[i]);
+		fprintf(f, ",roundtrip\n");
+	}
+
+	for(size_t r = 0; r < num_results; r++) {
+		bench_result_s * res = &results[r];
+		double * stage = (double*)&res->stages;
+		double encode_mbps = (double)size / 1000000.f / res->encode, decode_mbps = (double)size / 1000000.f / res->decode;
+		if(opts->json) {
+			fprintf(f, "  {\"block_size\": %llu, \"threads\": %i, \"packed_bytes\": %llu, \"encode_mbps\": %.3f, \"decode_mbps\": %.3f, \"stages_s\": {", 
+				(long long)res->block_size, res->threads, (long long)res->packed_size, encode_mbps, decode_mbps);
+			for(size_t i = 0; i < sizeof(bench_stage_names) / sizeof(bench_stage_names[0]); i++)
+				fprintf(f, "%s\"%s\": %.6f", i ? ", " : "", bench_stage_names[i], stage[i]);
+			fprintf(f, "}, \"roundtrip\": %s}%s\n", res->roundtrip ? "true" : "false", r + 1 < num_results ? "," : "");
+		} else {
+			fprintf(f, "%i,%s,%llu,%i,%i,%llu,%llu,%.3f,%.3f", BRC_VERSION, brc_simd_name(), 
+				(long long)res->block_size, res->threads, opts->iterations, (long long)size, (long long)res->packed_size, encode_mbps, decode_mbps);
+			for(size_t i = 0; i < sizeof(bench_stage_names) / sizeof(bench_stage_names[0]); i++)
+				fprintf(f, ",%.6f", stage[i]);
+			fprintf(f, ",%s\n", res->roundtrip ? "ok" : "failed");
+		}
+	}
+	if(opts->json) fprintf(f, "]}\n");
+}
+
+int bench(FILE * f_input, FILE * f_output, const char * corpus_name, cli_options_s * opts) {
+	size_t size = 0, capacity = BUFFER_SIZE, bytes_read;
+	unsigned char * corpus = (unsigned char*)malloc(capacity);
+	while(corpus && (bytes_read = fread(corpus + size, 1, capacity - size, f_input)) > 0) {
+		size += bytes_read;
+		if(size == capacity) {
+			unsigned char * grown = (unsigned char*)realloc(corpus, capacity *= 2);
+			if(!grown) free(corpus);
+			corpus = grown;
+		}
+	}
+	if(!corpus) 
+		return printf(" Failed to allocate input!  \n"), EXIT_FAILURE;
+	if(size == 0) 
+		return free(corpus), printf(" Empty corpus!  \n"), EXIT_FAILURE;
+
+	/* segments are parallel regions inside the benchmark's own */
+	if(opts->segments > 1) omp_set_max_active_levels(2);
+
+	size_t num_results = opts->num_block_sizes * opts->num_thread_counts;
+	bench_result_s * results = (bench_result_s*)calloc(num_results, sizeof(bench_result_s));
+	if(!results) 
+		return free(corpus), printf(" Failed to allocate benchmark!  \n"), EXIT_FAILURE;
+
+	printf(" %s: %llu bytes, %i iterations, SIMD kernels: %s \n", corpus_name, (long long)size, opts->iterations, brc_simd_name());
+	int err = EXIT_SUCCESS;
+	for(size_t i = 0, r = 0; i < opts->num_block_sizes; i++) {
+		for(size_t j = 0; j < opts->num_thread_counts; j++, r++) {
+			bench_result_s * res = &results[r];
+			if(bench_config(corpus, size, opts->block_sizes[i], opts->thread_counts[j], opts, res) != EXIT_SUCCESS) err = EXIT_FAILURE;
+			printf(" block %8llu, %2i threads: %llu => %llu bytes, encode %8.3f MB/s, decode %8.3f MB/s, round trip %s \n", 
+				(long long)res->block_size, res->threads, (long long)size, (long long)res->packed_size,
+				(double)size / 1000000.f / res->encode, (double)size / 1000000.f / res->decode, res->roundtrip ? "ok" : "FAILED");
+
+			/* per stage rates are per thread, the time of a stage being added up over all threads */
+			double * stage = (double*)&res->stages;
+			printf("   stages:");
+			for(size_t k = 0; k < sizeof(bench_stage_names) / sizeof(bench_stage_names[0]); k++)
+				if(stage[k] > 0) printf(" %s %.1f MB/s", bench_stage_names[k], (double)size / 1000000.f / stage[k]);
+			printf(" \n");
+		}
+	}
+
+	bench_report(f_output, corpus_name, size, opts, results, num_results);
+	free(results);
+	free(corpus);
+	return err;
+}
+
+int main(int argc, char ** argv) {
+	if(argc < 4 && !(argc == 3 && argv[1][0] == 't')) {
+		printf(" BRC version %i - Behemoth Rank Coding for BWT \n\
+ Lucas Marsh (c) 2018, MIT licensed \n\
+ SIMD kernels: %s \n\
+ Usage:  brc.exe  <c|d|r|b>  input  output  [num-threads] [options]\n\
+         brc.exe  t  input  [num-threads] [options]\n\
+ Arguments: \n\
+    c : compress \n\
+    d : decompress \n\
+    r : decompress the byte range given by --offset and --length \n\
+    t : test 'input' by decoding every block in memory, against its checksums if it has them, without an output \n\
+    b : benchmark 'input' in memory and write the report to 'output' \n\
+ Options: \n\
+    --segments N : split every block into N segments with their own threads (compress only) \n\
+    --interleave N : decode N blocks, or N segments of a block, together on each thread, 1 to 4 (decompress only) \n\
+    --block-size N : bytes per block, K, M and G suffixes allowed, 1M by default (compress only) \n\
+    --memory N   : fit block size and threads to N bytes of memory, decompression only drops threads \n\
+    --offset N   : first byte of the range to decompress \n\
+    --length N   : number of bytes to decompress \n\
+    --mmap       : memory map input and output instead of buffered reads and writes (c and d) \n\
+    --entropy    : entropy code every block with order-0 rANS for final compressed output (compress only) \n\
+    --bwt        : BWT raw input before coding, decompression inverts it (compress only) \n\
+    --pages thp|huge : allocate blocks on transparent or explicitly reserved huge pages \n\
+    --checksum   : store a CRC32C of every block, checked on every decode except the fallback for a container that lost its index (compress only) \n\
+    --split      : end a block early where the statistics of the input shift, if coding the two parts apart is smaller; not with --bwt (compress only) \n\
+    --low-memory : code every block in place in a single buffer on one thread, blocks take a faster rank stage; decompression needs such a container (c and d) \n\
+    -1 .. -%i     : level, lower ones pick a faster rank stage for blocks where it costs little; -%i, the default, always ranks (compress only) \n\
+    --iterations N        : benchmark repetitions, 3 by default \n\
+    --block-sizes 256K,1M : block sizes to sweep in the benchmark \n\
+    --threads 1,2,4       : thread counts to sweep in the benchmark, powers of two up to num-threads by default \n\
+    --json                : write the benchmark report as JSON instead of CSV \n\
+    --stats file : write statistics of every block as JSON lines (compress only, needs a build with -DBRC_STATS) \n\
+ Press 'enter' to continue", BRC_VERSION, brc_simd_name(), BRC_MAX_LEVEL, BRC_MAX_LEVEL);
+		getchar();
+		return 0;
+	}
+
+	cli_options_s opts;
+	opts.num_threads = 4;
+	opts.segments = 1;
+	opts.interleave = 1;
+	opts.block_size = BUFFER_SIZE;
+	opts.block_size_set = false;
+	opts.memory = 0;
+	opts.offset = 0;
+	opts.length = UINT64_MAX;
+	opts.mmap = false;
+	opts.entropy = false;
+	opts.bwt = false;
+	opts.low_memory = false;
+	opts.split = false;
+	opts.checksum = false;
+	opts.pages = BRC_PAGES_SMALL;
+	opts.level = BRC_MAX_LEVEL;
+	opts.iterations = 3;
+	opts.json = false;
+	opts.num_block_sizes = opts.num_thread_counts = 0;
+	opts.f_stats = NULL;
+	const char * stats_path = NULL;
+	/* 't' has no output argument */
+	int first_option = argv[1][0] == 't' ? 3 : 4;
+	for(int i = first_option; i < argc; i++) {
+		if(strcmp(argv[i], "--segments") == 0 && i + 1 < argc) opts.segments = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--interleave") == 0 && i + 1 < argc) opts.interleave = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--block-size") == 0 && i + 1 < argc) {
+			const char * end = cli_parse_size(argv[++i], &opts.block_size);
+			if(end == NULL || *end != 0) return printf(" Invalid option %s \n", argv[i]), EXIT_FAILURE;
+			opts.block_size_set = true;
+		}
+		else if(strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+			const char * end = cli_parse_size(argv[++i], &opts.memory);
+			if(end == NULL || *end != 0 || opts.memory == 0) return printf(" Invalid option %s \n", argv[i]), EXIT_FAILURE;
+		}
+		else if(strcmp(argv[i], "--offset") == 0 && i + 1 < argc) opts.offset = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--length") == 0 && i + 1 < argc) opts.length = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--mmap") == 0) opts.mmap = true;
+		else if(strcmp(argv[i], "--entropy") == 0) opts.entropy = true;
+		else if(strcmp(argv[i], "--bwt") == 0) opts.bwt = true;
+		else if(strcmp(argv[i], "--low-memory") == 0) opts.low_memory = true;
+		else if(strcmp(argv[i], "--split") == 0) opts.split = true;
+		else if(strcmp(argv[i], "--checksum") == 0) opts.checksum = true;
+		else if(strcmp(argv[i], "--pages") == 0 && i + 1 < argc) {
+			i++;
+			if(strcmp(argv[i], "thp") == 0) opts.pages = BRC_PAGES_THP;
+			else if(strcmp(argv[i], "huge") == 0) opts.pages = BRC_PAGES_HUGE;
+			else return printf(" Invalid option %s \n", argv[i]), EXIT_FAILURE;
+		}
+		else if(strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) opts.iterations = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--json") == 0) opts.json = true;
+		else if(strcmp(argv[i], "--stats") == 0 && i + 1 < argc) stats_path = argv[++i];
+		else if(strcmp(argv[i], "--block-sizes") == 0 && i + 1 < argc) {
+			opts.num_block_sizes = cli_parse_list(argv[++i], opts.block_sizes, BENCH_MAX_SWEEP);
+			if(opts.num_block_sizes == 0) return printf(" Invalid option %s \n", argv[i]), EXIT_FAILURE;
+		}
+		else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			opts.num_thread_counts = cli_parse_list(argv[++i], opts.thread_counts, BENCH_MAX_SWEEP);
+			if(opts.num_thread_counts == 0) return printf(" Invalid option %s \n", argv[i]), EXIT_FAILURE;
+		}
+		else if(argv[i][0] == '-' && argv[i][1] >= '1' && argv[i][1] <= '0' + BRC_MAX_LEVEL && argv[i][2] == 0) opts.level = argv[i][1] - '0';
+		else if(argv[i][0] != '-') opts.num_threads = atoi(argv[i]);
+		else return printf(" Invalid option %s \n", argv[i]), EXIT_FAILURE;
+	}
+	if(opts.num_threads < 1 || opts.segments < 1 || opts.iterations < 1 || opts.interleave < 1 || opts.interleave > BRC_MAX_INTERLEAVE) return printf(" Invalid argument!\n"), EXIT_FAILURE;
+	if(opts.block_size == 0 || opts.block_size > SIZE_MAX / 4) return printf(" Invalid block size!\n"), EXIT_FAILURE;
+	if(opts.low_memory && (opts.bwt || opts.entropy || opts.segments > 1 || opts.mmap || opts.split)) return printf(" --low-memory cannot be combined with --bwt, --entropy, --segments, --mmap or --split!\n"), EXIT_FAILURE;
+	/* brc_split estimates blocks as they are coded without the BWT, while a cut has to be placed before it */
+	if(opts.split && opts.bwt) return printf(" --split cannot be combined with --bwt!\n"), EXIT_FAILURE;
+	if(opts.bwt && opts.block_size > BWT_MAX_SIZE) return printf(" Blocks of more than %llu bytes cannot be BWT transformed!\n", (long long)BWT_MAX_SIZE), EXIT_FAILURE;
+	if(opts.num_block_sizes == 0) {
+		opts.block_sizes[0] = 1 << 18;
+		opts.block_sizes[1] = 1 << 20;
+		opts.block_sizes[2] = 1 << 22;
+		opts.num_block_sizes = 3;
+	}
+	if(opts.num_thread_counts == 0) {
+		for(int t = 1; t < opts.num_threads && opts.num_thread_counts + 1 < BENCH_MAX_SWEEP; t *= 2)
+			opts.thread_counts[opts.num_thread_counts++] = t;
+		opts.thread_counts[opts.num_thread_counts++] = opts.num_threads;
+	}
+	for(size_t i = 0; i < opts.num_block_sizes; i++)
+		if(opts.block_sizes[i] == 0) return printf(" Invalid argument!\n"), EXIT_FAILURE;
+	for(size_t i = 0; i < opts.num_thread_counts; i++)
+		if(opts.thread_counts[i] < 1 || opts.thread_counts[i] > 1024) return printf(" Invalid argument!\n"), EXIT_FAILURE;
+
+	if(first_option == 4 && strcmp(argv[2], argv[3]) == 0) return perror(" Refusing to write to input, change the output directory! \n"), EXIT_FAILURE;
+
+	if(stats_path) {
+		if(!brc_stats_enabled()) return printf(" --stats needs brc built with -DBRC_STATS \n"), EXIT_FAILURE;
+		if((opts.f_stats = fopen(stats_path, "w")) == NULL) return perror(stats_path), EXIT_FAILURE;
+	}
+
+	/* decoding takes its block size and whether it needs the BWT's memory from the container header */
+	if(opts.memory && argv[1][0] != 'b') {
+		bool decoding = argv[1][0] != 'c';
+		FILE * f = fopen(argv[2], "rb");
+		if(f == NULL) return perror(argv[2]), EXIT_FAILURE;
+		uint64_t input_size = cli_file_size(f);
+		brc_header_s header;
+		if(decoding && brc_read_header(f, &header) == BRC_EXIT_FAILURE) return fclose(f), EXIT_FAILURE;
+		fclose(f);
+		if(decoding) {
+			opts.block_size = header.block_size;
+			opts.bwt = (header.flags & BRC_FLAG_BWT) != 0;
+		}
+		if(cli_fit_memory(&opts, input_size, decoding) != EXIT_SUCCESS) return EXIT_FAILURE;
+	}
+
+	if(argv[1][0] == 't') {
+		if(verify_mapped(argv[2], &opts) != EXIT_SUCCESS)
+			return printf(" Verification failed!  \n"), EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
+	if(opts.mmap && argv[1][0] == 'c') {
+		if(encode_mapped(argv[2], argv[3], &opts) != EXIT_SUCCESS)
+			return printf(" Encoding failed!  \n"), EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
+	if(opts.mmap && argv[1][0] == 'd') {
+		if(decode_mapped(argv[2], argv[3], &opts) != EXIT_SUCCESS)
+			return printf(" Decoding failed!  \n"), EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
+
+	FILE* f_input  = fopen(argv[2], "rb");
+	FILE* f_output = fopen(argv[3], "wb");
+	if (f_input  == NULL) return perror(argv[2]), 1;
+	if (f_output == NULL) return perror(argv[3]), 1;
+
+	switch(argv[1][0]) {
+		case 'c': {
+			if(opts.low_memory) {
+				if(encode_stream_inplace(f_input, f_output, &opts) != EXIT_SUCCESS)
+					return printf(" Encoding failed!  \n"), EXIT_FAILURE;
+			} else if(opts.num_threads > 1) {
+				if(encode_stream_parallel(f_input, f_output, &opts) != EXIT_SUCCESS)
+					return printf(" Encoding failed!  \n"), EXIT_FAILURE;
+			} else {
+				if(encode_stream_serial(f_input, f_output, &opts) != EXIT_SUCCESS)
+					return printf(" Encoding failed!  \n"), EXIT_FAILURE;
+			}
+		} break;
+		case 'd': {
+			if(opts.low_memory) {
+				if(decode_stream_inplace(f_input, f_output) != EXIT_SUCCESS)
+					return printf(" Decoding failed!  \n"), EXIT_FAILURE;
+				break;
+			}
+			bool indexed;
+			if(decode_indexed(f_input, f_output, &opts, 0, UINT64_MAX, &indexed) == EXIT_SUCCESS) break;
+			/* a truncated container has no index, fall back to walking the block headers */
+			if(indexed || ftell(f_output) != 0 || fseek(f_input, 0, SEEK_SET) != 0)
+				return printf(" Decoding failed!  \n"), EXIT_FAILURE;
+			if(opts.num_threads > 1) {
+				if(decode_stream_parallel(f_input, f_output, &opts) != EXIT_SUCCESS)
+					return printf(" Decoding failed!  \n"), EXIT_FAILURE;
+			} else {
+				if(decode_stream_serial(f_input, f_output, &opts) != EXIT_SUCCESS)
+					return printf(" Decoding failed!  \n"), EXIT_FAILURE;
+			}
+		} break;
+		case 'b': {
+			if(bench(f_input, f_output, argv[2], &opts) != EXIT_SUCCESS)
+				return printf(" Benchmark failed!  \n"), EXIT_FAILURE;
+		} break;
+		case 'r': {
+			uint64_t end = opts.length > UINT64_MAX - opts.offset ? UINT64_MAX : opts.offset + opts.length;
+			bool indexed;
+			if(decode_indexed(f_input, f_output, &opts, opts.offset, end, &indexed) != EXIT_SUCCESS)
+				return printf(" Decoding failed!  \n"), EXIT_FAILURE;
+		} break;
+		default: printf(" Invalid argument!\n");
+	}
+
+	fclose(f_input);
+	fclose(f_output);
+	if(opts.f_stats) fclose(opts.f_stats);
+	return EXIT_SUCCESS;
+}
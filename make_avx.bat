@@ -1,2 +1,2 @@
-g++ -std=c++11 -Ofast -s -static -fopenmp -funroll-loops -ftree-vectorize -mavx main.cpp brc.cpp -o brc_avx
+g++ -std=c++11 -Ofast -s -static -fopenmp -pthread -funroll-loops -ftree-vectorize -mavx main.cpp brc.cpp container.cpp rans.cpp bwt.cpp engine.cpp -o brc_avx
 PAUSE
\ No newline at end of file
@@ -1,2 +1,2 @@
-g++ -std=c++11 -Ofast -s -static -fopenmp -funroll-loops -ftree-vectorize -msse2 main.cpp brc.cpp -o brc_sse2
+g++ -std=c++11 -Ofast -s -static -fopenmp -pthread -funroll-loops -ftree-vectorize -msse2 main.cpp brc.cpp container.cpp rans.cpp bwt.cpp engine.cpp -o brc_sse2
 PAUSE
\ No newline at end of file
@@ -0,0 +1,251 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "rans.hpp"
+#include "brc.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BRC_X86 1
+#include <immintrin.h>
+#endif
+
+#define RANS_LANES (8)
+#define RANS_SCALE_BITS (12)
+#define RANS_SCALE (1u << RANS_SCALE_BITS)
+#define RANS_L (1u << 16)
+#define RANS_BITMAP_SIZE (32)
+
+/*** frequency table ***/
+/* scales the histogram to RANS_SCALE keeping every present symbol at 1 or more */
+void rans_normalize(size_t * hist, size_t total, uint32_t * freqs) {
+	uint32_t sum = 0;
+	size_t max_sym = 0;
+	for(size_t i = 0; i < 256; i++) {
+		freqs[i] = 0;
+		if(hist[i] == 0) continue;
+		freqs[i] = (uint32_t)(((uint64_t)hist[i] * RANS_SCALE) / total);
+		if(freqs[i] == 0) freqs[i] = 1;
+		sum += freqs[i];
+		if(hist[i] > hist[max_sym]) max_sym = i;
+	}
+	if(sum < RANS_SCALE) freqs[max_sym] += RANS_SCALE - sum;
+	while(sum > RANS_SCALE) {
+		size_t big = 0;
+		for(size_t i = 1; i < 256; i++)
+			if(freqs[i] > freqs[big]) big = i;
+		freqs[big]--, sum--;
+	}
+}
+
+/* one entry per slot: symbol << 24 | (frequency - 1) << 12 | (slot - start), so a single gather decodes a lane */
+void rans_build_table(uint32_t * freqs, uint32_t * table) {
+	for(uint32_t i = 0, start = 0; i < 256; i++) {
+		for(uint32_t j = 0; j < freqs[i]; j++)
+			table[start + j] = (i << 24) | ((freqs[i] - 1) << 12) | j;
+		start += freqs[i];
+	}
+}
+
+/*** encoder ***/
+size_t rans_encode(unsigned char * src, size_t size, unsigned char * dst, size_t dst_capacity) {
+	size_t hist[256] = {0};
+	uint32_t freqs[256], starts[256];
+	for(size_t i = 0; i < size; i++)
+		hist[src[i]]++;
+	if(size == 0) return 0;
+	rans_normalize(hist, size, freqs);
+
+	size_t header_size = sizeof(uint64_t) + RANS_BITMAP_SIZE;
+	for(uint32_t i = 0, start = 0; i < 256; i++) {
+		starts[i] = start;
+		start += freqs[i];
+		if(freqs[i] > 0) header_size += sizeof(uint16_t);
+	}
+	if(header_size >= dst_capacity) return 0;
+
+	/* symbols are coded last to first, so the words are written back to front and end up in decoding order */
+	unsigned char * write_head = dst + dst_capacity, * write_end = dst + header_size;
+	uint32_t x[RANS_LANES];
+	for(size_t j = 0; j < RANS_LANES; j++)
+		x[j] = RANS_L;
+
+	for(size_t i = size; i-- > 0;) {
+		uint32_t & state = x[i % RANS_LANES];
+		uint32_t freq = freqs[src[i]];
+		uint64_t x_max = (uint64_t)((RANS_L >> RANS_SCALE_BITS) << 16) * freq;
+		if(state >= x_max) {
+			if(write_head - write_end < (ptrdiff_t)sizeof(uint16_t)) return 0;
+			uint16_t word = state & 0xffff;
+			write_head -= sizeof(word);
+			memcpy(write_head, &word, sizeof(word));
+			state >>= 16;
+		}
+		state = ((state / freq) << RANS_SCALE_BITS) + (state % freq) + starts[src[i]];
+	}
+	for(size_t j = RANS_LANES; j-- > 0;) {
+		if(write_head - write_end < (ptrdiff_t)sizeof(uint32_t)) return 0;
+		write_head -= sizeof(uint32_t);
+		memcpy(write_head, &x[j], sizeof(uint32_t));
+	}
+
+	uint64_t num_symbols = size;
+	unsigned char * header = dst;
+	memcpy(header, &num_symbols, sizeof(num_symbols));
+	header += sizeof(num_symbols);
+	memset(header, 0, RANS_BITMAP_SIZE);
+	for(size_t i = 0; i < 256; i++)
+		if(freqs[i] > 0)
+			header[i >> 3] |= 1 << (i & 7);
+	header += RANS_BITMAP_SIZE;
+	for(size_t i = 0; i < 256; i++) {
+		if(freqs[i] == 0) continue;
+		uint16_t freq = freqs[i] - 1;
+		memcpy(header, &freq, sizeof(freq));
+		header += sizeof(freq);
+	}
+
+	size_t stream_size = dst + dst_capacity - write_head;
+	memmove(header, write_head, stream_size);
+	return header_size + stream_size;
+}
+
+/*** decoder ***/
+/* decodes symbols 'begin' to 'size', returns the new read position or NULL if the words run out */
+unsigned char * rans_decode_std(uint32_t * table, uint32_t * x, unsigned char * read_head, unsigned char * read_end, unsigned char * dst, size_t begin, size_t size) {
+	for(size_t i = begin; i < size; i++) {
+		uint32_t & state = x[i % RANS_LANES];
+		uint32_t e = table[state & (RANS_SCALE - 1)];
+		dst[i] = e >> 24;
+		state = (((e >> 12) & 0xfff) + 1) * (state >> RANS_SCALE_BITS) + (e & 0xfff);
+		if(state < RANS_L) {
+			uint16_t word;
+			if(read_end - read_head < (ptrdiff_t)sizeof(word)) return NULL;
+			memcpy(&word, read_head, sizeof(word));
+			read_head += sizeof(word);
+			state = (state << 16) | word;
+		}
+	}
+	return read_head;
+}
+
+#ifdef BRC_X86
+/* for every renormalization mask, which of the loaded words each lane takes */
+struct alignas(32) rans_perm_s {
+	uint32_t lanes[256][RANS_LANES];
+};
+
+static rans_perm_s rans_build_perm() {
+	rans_perm_s p;
+	for(size_t m = 0; m < 256; m++) {
+		for(size_t j = 0, k = 0; j < RANS_LANES; j++) {
+			p.lanes[m][j] = k;
+			if(m & (1 << j)) k++;
+		}
+	}
+	return p;
+}
+
+static const rans_perm_s & rans_perm() {
+	static const rans_perm_s p = rans_build_perm();
+	return p;
+}
+
+/* eight lanes per step: gather the slot entries, update every state, then refill the lanes that dropped below RANS_L from consecutive words */
+__attribute__((target("avx2"))) unsigned char * rans_decode_avx2(uint32_t * table, uint32_t * x, unsigned char * read_head, unsigned char * read_end, unsigned char * dst, size_t begin, size_t size) {
+	const rans_perm_s & perm = rans_perm();
+	const __m256i slot_mask = _mm256_set1_epi32(RANS_SCALE - 1);
+	const __m256i field_mask = _mm256_set1_epi32(0xfff);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i low = _mm256_set1_epi32(RANS_L - 1);
+	const __m256i pick = _mm256_setr_epi8(
+		3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m256i state = _mm256_loadu_si256((const __m256i*)x);
+
+	size_t i = begin;
+	for(; i + RANS_LANES <= size && read_end - read_head >= (ptrdiff_t)sizeof(__m128i); i += RANS_LANES) {
+		__m256i e = _mm256_i32gather_epi32((const int*)table, _mm256_and_si256(state, slot_mask), 4);
+		__m256i freq = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(e, 12), field_mask), one);
+		state = _mm256_add_epi32(_mm256_mullo_epi32(freq, _mm256_srli_epi32(state, RANS_SCALE_BITS)), _mm256_and_si256(e, field_mask));
+
+		__m256i syms = _mm256_shuffle_epi8(e, pick);
+		uint32_t lo = _mm256_extract_epi32(syms, 0), hi = _mm256_extract_epi32(syms, 4);
+		memcpy(dst + i, &lo, sizeof(lo));
+		memcpy(dst + i + 4, &hi, sizeof(hi));
+
+		__m256i need = _mm256_cmpeq_epi32(_mm256_min_epu32(state, low), state);
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(need));
+		__m256i words = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)read_head));
+		words = _mm256_permutevar8x32_epi32(words, _mm256_load_si256((const __m256i*)perm.lanes[mask]));
+		state = _mm256_blendv_epi8(state, _mm256_or_si256(_mm256_slli_epi32(state, 16), words), need);
+		read_head += sizeof(uint16_t) * __builtin_popcount(mask);
+	}
+
+	_mm256_storeu_si256((__m256i*)x, state);
+	return rans_decode_std(table, x, read_head, read_end, dst, i, size);
+}
+#endif
+
+/*** runtime cpu dispatch ***/
+typedef unsigned char * (*rans_decode_fn)(uint32_t * table, uint32_t * x, unsigned char * read_head, unsigned char * read_end, unsigned char * dst, size_t begin, size_t size);
+
+static rans_decode_fn rans_detect_cpu() {
+#ifdef BRC_X86
+	__builtin_cpu_init();
+	if(brc_simd_cap() >= 2 && __builtin_cpu_supports("avx2"))
+		return rans_decode_avx2;
+#endif
+	return rans_decode_std;
+}
+
+static rans_decode_fn rans_dispatch() {
+	static const rans_decode_fn d = rans_detect_cpu();
+	return d;
+}
+
+int rans_decode(unsigned char * src, size_t src_size, unsigned char * dst, size_t dst_capacity, size_t * dst_size) {
+	unsigned char * read_head = src, * read_end = src + src_size;
+	uint64_t num_symbols;
+	if(src_size < sizeof(num_symbols) + RANS_BITMAP_SIZE) return BRC_EXIT_FAILURE;
+	memcpy(&num_symbols, read_head, sizeof(num_symbols));
+	read_head += sizeof(num_symbols);
+	if(num_symbols > dst_capacity) return BRC_EXIT_FAILURE;
+
+	unsigned char * bitmap = read_head;
+	read_head += RANS_BITMAP_SIZE;
+	uint32_t freqs[256], sum = 0;
+	for(size_t i = 0; i < 256; i++) {
+		uint16_t freq = 0;
+		freqs[i] = 0;
+		if(!(bitmap[i >> 3] & (1 << (i & 7)))) continue;
+		if(read_end - read_head < (ptrdiff_t)sizeof(freq)) return BRC_EXIT_FAILURE;
+		memcpy(&freq, read_head, sizeof(freq));
+		read_head += sizeof(freq);
+		freqs[i] = (uint32_t)freq + 1;
+		sum += freqs[i];
+	}
+	if(sum != RANS_SCALE) return BRC_EXIT_FAILURE;
+
+	uint32_t x[RANS_LANES];
+	if(read_end - read_head < (ptrdiff_t)sizeof(x)) return BRC_EXIT_FAILURE;
+	memcpy(x, read_head, sizeof(x));
+	read_head += sizeof(x);
+	for(size_t j = 0; j < RANS_LANES; j++)
+		if(x[j] < RANS_L) return BRC_EXIT_FAILURE;
+
+	uint32_t table[RANS_SCALE];
+	rans_build_table(freqs, table);
+	read_head = rans_dispatch()(table, x, read_head, read_end, dst, 0, num_symbols);
+
+	/* a sound stream uses up every word and leaves each state where the encoder started it */
+	if(read_head != read_end) return BRC_EXIT_FAILURE;
+	for(size_t j = 0; j < RANS_LANES; j++)
+		if(x[j] != RANS_L) return BRC_EXIT_FAILURE;
+	*dst_size = num_symbols;
+	return BRC_EXIT_SUCCESS;
+}
@@ -0,0 +1,25 @@
+/*
+	BRC - Behemoth Rank Coding for BWT
+	MIT License
+	Copyright (c) 2018 Lucas Marsh
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "common.hpp"
+
+/*
+	Order-0 rANS with 8 interleaved 32 bit states, 12 bit probabilities and 16 bit renormalization:
+		header : uint64 number of symbols, 32 byte bitmap of present symbols, uint16 frequency - 1 per present symbol
+		states : 8 final encoder states, uint32 each
+		words  : uint16 renormalization words in the order the decoder consumes them
+	Symbol i belongs to state i % 8, so 8 symbols decode at once with AVX2.
+*/
+
+/* codes 'size' bytes of 'src' into 'dst'; returns the coded size, or 0 if it would not be smaller than 'dst_capacity' */
+size_t rans_encode(unsigned char * src, size_t size, unsigned char * dst, size_t dst_capacity);
+
+/* decodes a stream of 'src_size' bytes into 'dst'; returns 0 on success, else -1 for a damaged stream or one larger than 'dst_capacity' */
+int rans_decode(unsigned char * src, size_t src_size, unsigned char * dst, size_t dst_capacity, size_t * dst_size);